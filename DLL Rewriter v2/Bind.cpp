@@ -0,0 +1,179 @@
+#include "Bind.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+#include "Imports.h"
+
+using std::map;
+using std::pair;
+using std::string;
+using std::vector;
+
+namespace PElib
+{
+
+// Layout: PeBoundImportDescriptor for every module, each followed by its
+// PeBoundForwarderRefs, a null descriptor, then module names. Name offsets are
+// relative to the start of the directory.
+string BuildBoundDirectory(const vector<BoundImport>& bound)
+{
+	uint entries = 1;
+	for (const auto& module : bound)
+		entries += 1 + module.forwarder_refs.size();
+	string res(entries * sizeof(PeBoundImportDescriptor), '\0');
+
+	map<string, ushort> name_offsets;
+	auto put_name = [&](const string& name) -> ushort
+	{
+		auto it = name_offsets.find(name);
+		if (it != name_offsets.end())
+			return it->second;
+		if (res.size() + name.size() + 1 > 0xFFFF)
+			fatal_error("Bound import directory too big");
+		ushort offset = (ushort)res.size();
+		res.append(name.c_str(), name.size() + 1);
+		name_offsets[name] = offset;
+		return offset;
+	};
+
+	uint pos = 0;
+	for (const auto& module : bound)
+	{
+		PeBoundImportDescriptor desc;
+		desc.TimeDateStamp = module.timestamp;
+		desc.OffsetModuleName = put_name(module.name);
+		desc.NumberOfModuleForwarderRefs = (ushort)module.forwarder_refs.size();
+		memcpy(&res[pos], &desc, sizeof(desc));
+		pos += sizeof(desc);
+		for (const auto& ref : module.forwarder_refs)
+		{
+			PeBoundForwarderRef fwd;
+			fwd.TimeDateStamp = ref.second;
+			fwd.OffsetModuleName = put_name(ref.first);
+			fwd.Reserved = 0;
+			memcpy(&res[pos], &fwd, sizeof(fwd));
+			pos += sizeof(fwd);
+		}
+	}
+	return res;
+}
+
+vector<BoundImport> ParseBoundImports(const PEEdit& pe)
+{
+	vector<BoundImport> res;
+	const auto& bound_dir_entry =
+		pe.PeHeader().OptionalHeader.DataDirectory[pe_directory_bound_import];
+	if (!bound_dir_entry.VirtualAddress || !bound_dir_entry.Size)
+		return res;
+	// bind.exe puts the directory right after section headers.
+	string data;
+	const auto& view = pe.View();
+	if (bound_dir_entry.VirtualAddress + bound_dir_entry.Size <= view.OptionalHeader().SizeOfHeaders)
+		data = view.Data().substr(bound_dir_entry.VirtualAddress, bound_dir_entry.Size);
+	else
+		data = pe.Read(RVA{ bound_dir_entry.VirtualAddress }, bound_dir_entry.Size);
+
+	auto read_name = [&data](ushort offset) -> string
+	{
+		if (offset >= data.size())
+			fatal_error("Bad module name offset in bound import directory");
+		return string(data.c_str() + offset);
+	};
+	uint pos = 0;
+	for (;;)
+	{
+		PeBoundImportDescriptor desc;
+		if (pos + sizeof(desc) > data.size())
+			fatal_error("Unterminated bound import directory");
+		memcpy(&desc, &data[pos], sizeof(desc));
+		pos += sizeof(desc);
+		if (!desc.TimeDateStamp && !desc.OffsetModuleName)
+			break;
+		BoundImport bound = { read_name(desc.OffsetModuleName), desc.TimeDateStamp, {} };
+		for (uint i = 0; i < desc.NumberOfModuleForwarderRefs; i++)
+		{
+			PeBoundForwarderRef ref;
+			if (pos + sizeof(ref) > data.size())
+				fatal_error("Unterminated bound import directory");
+			memcpy(&ref, &data[pos], sizeof(ref));
+			pos += sizeof(ref);
+			bound.forwarder_refs.push_back(
+				std::make_pair(read_name(ref.OffsetModuleName), (uint)ref.TimeDateStamp));
+		}
+		res.push_back(bound);
+	}
+	return res;
+}
+
+vector<ModuleBinding> BindImports(PEEdit& pe, ModuleCache& modules)
+{
+	vector<ModuleBinding> res;
+	vector<BoundImport> bound;
+	for (const auto& imported : ParseImports(pe))
+	{
+		ModuleBinding binding = { imported.name, false, 0, "" };
+		const CachedModule* module = modules.Module(imported.name);
+		if (!imported.has_lookup_table)
+			binding.reason = "no lookup table (OriginalFirstThunk)";
+		else if (!module)
+			binding.reason = "module not found";
+
+		vector<uint> vas;
+		BoundImport bound_module = { imported.name, module ? module->timestamp : 0, {} };
+		for (const auto& import : imported.imports)
+		{
+			if (!binding.reason.empty())
+				break;
+			auto symbol = ImportedModule::Symbol(import);
+			auto target = modules.ResolveSymbol(imported.name, symbol);
+			if (target.status != ResolveStatus::Ok)
+			{
+				binding.reason = format("%s: %s (at %s!%s)", symbol.c_str(),
+				                        ResolveStatusName(target.status),
+				                        target.module.c_str(), target.symbol.c_str());
+				break;
+			}
+			const CachedModule* target_module = modules.Module(target.module);
+			vas.push_back(target_module->image_base + target.rva.val);
+			auto& refs = bound_module.forwarder_refs;
+			if (target_module != module
+				&& std::none_of(refs.begin(), refs.end(), [&](const pair<string, uint>& ref)
+				                {
+				                    return modules.Module(ref.first) == target_module;
+				                }))
+				refs.push_back(std::make_pair(target.module + ".dll", target_module->timestamp));
+		}
+		if (binding.reason.empty())
+		{
+			for (size_t i = 0; i < vas.size(); i++)
+				pe.Patch(imported.imports[i].iat_slot, &vas[i], sizeof(vas[i]));
+			// -1 in both fields means that bindings are described by the bound import
+			// directory (new-style binding).
+			auto desc = imported.descriptor;
+			desc.TimeDateStamp = 0xFFFFFFFF;
+			desc.ForwarderChain = 0xFFFFFFFF;
+			pe.Patch(imported.descriptor_rva, &desc, sizeof(desc));
+			bound.push_back(bound_module);
+			binding.bound = true;
+			binding.imports = vas.size();
+		}
+		res.push_back(binding);
+	}
+
+	if (!bound.empty())
+	{
+		auto rva = pe.NextFreeRVA();
+		string data = BuildBoundDirectory(bound);
+		pe.AddSection("bound",
+		              rva,
+		              align_up(data.size(), pe.PeHeader().OptionalHeader.SectionAlignment),
+		              data,
+		              pe_scn_cnt_initialized_data | pe_scn_mem_read);
+		pe.SetDirectory(pe_directory_bound_import, rva, data.size());
+	}
+	return res;
+}
+
+}
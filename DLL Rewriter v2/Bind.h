@@ -0,0 +1,45 @@
+/*
+Import binding, in the spirit of bind.exe. Imports are resolved (following forwarders)
+against DLLs from a `ModuleCache`, and their final VAs are written into the IAT. A bound
+import directory records timestamps of the DLLs used, so the loader can skip resolution
+as long as they are unchanged and loaded at their preferred bases. Otherwise it falls back
+to the lookup tables (OriginalFirstThunk), which are left intact.
+*/
+
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+#include "ModuleCache.h"
+#include "PEView.h"
+
+namespace PElib
+{
+
+struct ModuleBinding
+{
+	std::string module;
+	bool bound;
+	uint imports;       // Number of bound imports
+	std::string reason; // Why the module wasn't bound
+};
+
+struct BoundImport
+{
+	std::string name;
+	uint timestamp;
+	std::vector<std::pair<std::string, uint>> forwarder_refs; // Name and timestamp
+};
+
+// Reads the current bound import directory (which may lie in the headers).
+std::vector<BoundImport> ParseBoundImports(const PEEdit& pe);
+std::string BuildBoundDirectory(const std::vector<BoundImport>& bound);
+
+// Binds every imported module whose imports can all be resolved and puts the bound
+// import directory in a new section.
+std::vector<ModuleBinding> BindImports(PEEdit& pe, ModuleCache& modules);
+
+}
@@ -0,0 +1,43 @@
+#include "Compact.h"
+
+using std::string;
+using std::vector;
+
+namespace PElib
+{
+
+static bool can_merge(const PEEdit& pe, uint index, const vector<string>& keep_separate)
+{
+	const auto& first = pe.SectionHeader(index);
+	const auto& second = pe.SectionHeader(index + 1);
+	if (first.Characteristics != second.Characteristics)
+		return false;
+	for (const auto& name : keep_separate)
+		if ((int)index == pe.FindSection(name) || (int)index + 1 == pe.FindSection(name))
+			return false;
+	uint first_vsize = first.VirtualSize ? first.VirtualSize : first.SizeOfRawData;
+	return second.VirtualAddress
+		== first.VirtualAddress + align_up(first_vsize, pe.PeHeader().OptionalHeader.SectionAlignment);
+}
+
+CompactStats Compact(PEEdit& pe, const vector<string>& keep_separate)
+{
+	CompactStats stats = { 0, 0 };
+	// Merge first, so the tail of every merged section gets trimmed too. Zeros between
+	// merged sections have to stay in the file.
+	for (uint i = 0; i + 1 < pe.SectionCount();)
+	{
+		if (can_merge(pe, i, keep_separate))
+		{
+			pe.MergeWithNext(i);
+			stats.merged_sections++;
+		}
+		else
+			i++;
+	}
+	for (uint i = 0; i < pe.SectionCount(); i++)
+		stats.trimmed_bytes += pe.TrimSection(i);
+	return stats;
+}
+
+}
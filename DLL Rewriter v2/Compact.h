@@ -0,0 +1,28 @@
+/*
+Image compaction: merges adjacent sections with identical characteristics and trims
+trailing zeros from raw data. Sections keep their RVAs, so directories and code
+referencing them stay valid; only the file layout and header fields derived from it
+(SizeOfHeaders, PointerToRawData) change.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "PEView.h"
+
+namespace PElib
+{
+
+struct CompactStats
+{
+	uint merged_sections;
+	uint trimmed_bytes;
+};
+
+// Sections named in `keep_separate` are never merged (e.g. ones found by name later).
+CompactStats Compact(PEEdit& pe, const std::vector<std::string>& keep_separate);
+
+}
@@ -0,0 +1,272 @@
+#include "DelayLoad.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace PElib
+{
+
+static const char delay_state_magic[8] = { 'D', 'L', 'L', 'D', 'E', 'L', 'A', 'Y' };
+static const uint delay_state_version = 1;
+static const uint page_readwrite = 0x04;
+static const uint page_execute_readwrite = 0x40;
+
+// Stored at the start of "delaydat", so that a later run can undo the conversion.
+#pragma pack(push, 1)
+struct DelayLoadState
+{
+	char magic[8];
+	uint version;
+	PeDataDirectory import_directory; // Directories before the conversion
+	PeDataDirectory bound_directory;
+	PeDataDirectory delay_directory;
+	uint slot_count;                  // Followed by (RVA, original value) of every IAT slot
+};
+#pragma pack(pop)
+
+static bool same_module(const string& a, const string& b)
+{
+	return a.size() == b.size()
+		&& std::equal(a.begin(), a.end(), b.begin(),
+		              [](char x, char y) { return tolower(x) == tolower(y); });
+}
+
+static uint label(const map<string, uint>& labels, const string& name)
+{
+	auto it = labels.find(name);
+	if (it == labels.end())
+		fatal_error("Label %s not found in the delay-load code", name.c_str());
+	return it->second;
+}
+
+DelayLoadConversion::DelayLoadConversion(PEEdit& pe, const vector<string>& modules)
+	: pe(pe)
+{
+	if (pe.FindSection("delayimp") >= 0)
+		fatal_error("This DLL already has delay-loaded imports, convert the original one instead");
+	for (auto& module : ParseImports(pe))
+	{
+		bool delay = std::any_of(modules.begin(), modules.end(),
+		                         [&](const string& name) { return same_module(name, module.name); });
+		if (!delay)
+		{
+			kept.push_back(std::move(module));
+			continue;
+		}
+		if (!module.has_lookup_table && module.descriptor.TimeDateStamp)
+			fatal_error("Can't delay-load %s: it's bound and has no lookup table", module.name.c_str());
+		delayed.push_back(std::move(module));
+	}
+	for (const auto& name : modules)
+		if (!IsDelayed(name))
+			fatal_error("Can't delay-load %s: it's not imported", name.c_str());
+
+	auto old_bound = ParseBoundImports(pe);
+	had_bound_imports = !old_bound.empty();
+	for (const auto& entry : old_bound)
+	{
+		bool drop = IsDelayed(entry.name)
+			|| std::any_of(entry.forwarder_refs.begin(), entry.forwarder_refs.end(),
+			               [this](const std::pair<string, uint>& ref) { return IsDelayed(ref.first); });
+		if (drop)
+			unbound.push_back(entry.name);
+		else
+			bound.push_back(entry);
+	}
+}
+
+bool DelayLoadConversion::IsDelayed(const string& name) const
+{
+	return std::any_of(delayed.begin(), delayed.end(),
+	                   [&](const ImportedModule& m) { return same_module(name, m.name); });
+}
+
+string DelayLoadConversion::Source() const
+{
+	// The IAT may share a section with code (e.g. after /MERGE:.rdata=.text). Making it
+	// non-executable while other threads run there would crash them with DEP.
+	bool executable_iat = false;
+	for (const auto& module : delayed)
+		for (const auto& import : module.imports)
+			for (uint i = 0; i < pe.SectionCount(); i++)
+			{
+				const auto& header = pe.SectionHeader(i);
+				if (header.VirtualAddress <= import.iat_slot.val
+					&& import.iat_slot.val - header.VirtualAddress
+					   < std::max(header.VirtualSize, header.SizeOfRawData)
+					&& (header.Characteristics & pe_scn_mem_execute))
+					executable_iat = true;
+			}
+	string res = format("__iat_protection equ 0%xh\n",
+	                    executable_iat ? page_execute_readwrite : page_readwrite);
+	uint index = 0;
+	for (const auto& module : delayed)
+		for (size_t i = 0; i < module.imports.size(); i++)
+			res += format("delay_stub %d\n", index++);
+
+	const auto& optional_header = pe.PeHeader().OptionalHeader;
+	res += format("align 0%xh, db 0\n", optional_header.SectionAlignment);
+	res += "__data_begin:\n";
+	res += format("db '%.8s'\n", delay_state_magic);
+	res += format("dd %d\n", delay_state_version);
+	for (uint directory : { pe_directory_import, pe_directory_bound_import, pe_directory_delay_import })
+	{
+		const auto& entry = optional_header.DataDirectory[directory];
+		res += format("dd 0%08xh, 0%08xh\n", entry.VirtualAddress, entry.Size);
+	}
+	res += format("dd %d\n", DelayedImports());
+	for (const auto& module : delayed)
+		for (const auto& import : module.imports)
+		{
+			uint value;
+			memcpy(&value, pe.Read(import.iat_slot, sizeof(value)).data(), sizeof(value));
+			res += format("dd 0%08xh, 0%08xh\n", import.iat_slot.val, value);
+		}
+	res += "delay_runtime_data\n";
+
+	res += "__delay_modules:\n";
+	for (const auto& module : delayed)
+		res += format("delay_module 0%08xh\n", module.descriptor.Name);
+	res += "__delay_imports:\n";
+	for (uint m = 0; m < delayed.size(); m++)
+		for (const auto& import : delayed[m].imports)
+			res += format("delay_import %d, 0%08xh, %d, 0%08xh\n",
+			              m, import.name_rva.val, import.ordinal, import.iat_slot.val);
+
+	res += "__delay_directory:\n";
+	for (uint m = 0; m < delayed.size(); m++)
+	{
+		const auto& desc = delayed[m].descriptor;
+		res += format("delay_descriptor 0%08xh, %d, 0%08xh, 0%08xh\n",
+		              desc.Name, m, desc.FirstThunk, desc.OriginalFirstThunk);
+	}
+	res += "times 8 dd 0\n";
+	res += "__delay_directory_end:\n";
+
+	// Descriptors are read through `pe`, as other passes (e.g. binding) may have changed them.
+	res += "__import_directory:\n";
+	for (const auto& module : kept)
+	{
+		PeImportDescriptor desc;
+		memcpy(&desc, pe.Read(module.descriptor_rva, sizeof(desc)).data(), sizeof(desc));
+		if (std::any_of(unbound.begin(), unbound.end(),
+		                [&](const string& name) { return same_module(name, module.name); }))
+		{
+			desc.TimeDateStamp = 0;
+			desc.ForwarderChain = 0;
+		}
+		res += format("dd 0%08xh, 0%08xh, 0%08xh, 0%08xh, 0%08xh\n", desc.OriginalFirstThunk,
+		              desc.TimeDateStamp, desc.ForwarderChain, desc.Name, desc.FirstThunk);
+	}
+	res += "dd __kernel32_int, 0, 0, __kernel32_name, __kernel32_iat\n";
+	res += "times 5 dd 0\n";
+	res += "__import_directory_end:\n";
+
+	// Name offsets are relative to the directory, so it can be emitted as raw bytes.
+	res += "__bound_directory:\n";
+	if (had_bound_imports && !bound.empty())
+	{
+		string data = BuildBoundDirectory(bound);
+		for (size_t i = 0; i < data.size(); i++)
+			res += format(i % 16 ? ", 0%02xh" : "db 0%02xh", (uchar)data[i])
+			     + (i % 16 == 15 || i + 1 == data.size() ? "\n" : "");
+	}
+	res += "__bound_directory_end:\n";
+	return res;
+}
+
+void DelayLoadConversion::Apply(RVA rva, const string& code, const map<string, uint>& labels,
+                                vector<RVA>* fixups)
+{
+	const auto& optional_header = pe.PeHeader().OptionalHeader;
+	uint data_begin = label(labels, "__data_begin");
+	if (data_begin < rva.val || data_begin - rva.val > code.size()
+		|| data_begin % optional_header.SectionAlignment)
+		fatal_error("Bad __data_begin in the delay-load code");
+	string code_part = code.substr(0, data_begin - rva.val);
+	string data_part = code.substr(data_begin - rva.val);
+	// Code size includes padding up to `data_begin`, trim it.
+	code_part.resize(code_part.find_last_not_of('\0') + 1);
+	pe.AddSection("delayimp",
+	              rva,
+	              data_begin - rva.val,
+	              code_part,
+	              pe_scn_cnt_code | pe_scn_mem_read | pe_scn_mem_execute);
+	pe.AddSection("delaydat",
+	              RVA{ data_begin },
+	              align_up(data_part.size(), optional_header.SectionAlignment),
+	              data_part,
+	              pe_scn_cnt_initialized_data | pe_scn_mem_read | pe_scn_mem_write);
+
+	// Point every IAT slot to its stub.
+	bool relocatable = !(pe.PeHeader().FileHeader.Characteristics & pe_file_relocs_stripped);
+	uint index = 0;
+	for (const auto& module : delayed)
+		for (const auto& import : module.imports)
+		{
+			uint stub = optional_header.ImageBase + label(labels, format("delay_stub_%d", index++));
+			pe.Patch(import.iat_slot, &stub, sizeof(stub));
+			if (relocatable)
+				fixups->push_back(import.iat_slot);
+		}
+
+	uint import_dir = label(labels, "__import_directory");
+	pe.SetDirectory(pe_directory_import, RVA{ import_dir },
+	                label(labels, "__import_directory_end") - import_dir);
+	uint delay_dir = label(labels, "__delay_directory");
+	pe.SetDirectory(pe_directory_delay_import, RVA{ delay_dir },
+	                label(labels, "__delay_directory_end") - delay_dir);
+	if (had_bound_imports)
+	{
+		uint bound_dir = label(labels, "__bound_directory");
+		uint bound_dir_size = label(labels, "__bound_directory_end") - bound_dir;
+		pe.SetDirectory(pe_directory_bound_import, RVA{ bound_dir_size ? bound_dir : 0 },
+		                bound_dir_size);
+	}
+}
+
+uint DelayLoadConversion::DelayedImports() const
+{
+	uint res = 0;
+	for (const auto& module : delayed)
+		res += module.imports.size();
+	return res;
+}
+
+uint RestoreDelayLoad(PEEdit& pe, int data_index, vector<RVA>* removed_fixups)
+{
+	const auto& header = pe.SectionHeader(data_index);
+	DelayLoadState state;
+	if (header.SizeOfRawData < sizeof(state))
+		fatal_error("Section 'delaydat' is too small");
+	memcpy(&state, pe.Read(RVA{ header.VirtualAddress }, sizeof(state)).data(), sizeof(state));
+	if (memcmp(state.magic, delay_state_magic, sizeof(delay_state_magic)) != 0
+		|| state.version != delay_state_version)
+		fatal_error("Section 'delaydat' has no saved imports, rewrite the original DLL instead");
+	if (sizeof(state) + (ull)state.slot_count * 2 * sizeof(uint) > header.SizeOfRawData)
+		fatal_error("Section 'delaydat' is too small");
+
+	string slots = pe.Read(RVA{ header.VirtualAddress + (uint)sizeof(state) },
+	                       state.slot_count * 2 * sizeof(uint));
+	for (uint i = 0; i < state.slot_count; i++)
+	{
+		uint slot[2];
+		memcpy(slot, &slots[i * sizeof(slot)], sizeof(slot));
+		pe.Patch(RVA{ slot[0] }, &slot[1], sizeof(slot[1]));
+		removed_fixups->push_back(RVA{ slot[0] });
+	}
+	pe.SetDirectory(pe_directory_import, RVA{ state.import_directory.VirtualAddress },
+	                state.import_directory.Size);
+	pe.SetDirectory(pe_directory_bound_import, RVA{ state.bound_directory.VirtualAddress },
+	                state.bound_directory.Size);
+	pe.SetDirectory(pe_directory_delay_import, RVA{ state.delay_directory.VirtualAddress },
+	                state.delay_directory.Size);
+	return state.slot_count;
+}
+
+}
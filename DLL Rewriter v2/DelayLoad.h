@@ -0,0 +1,61 @@
+/*
+Conversion of selected imported modules to delay-load. Their import descriptors are
+dropped from the import directory, and their IAT slots initially point to stubs, which
+load the module and resolve the function on the first call (see delay_load.asm).
+
+Code and data are generated from delay_load.asm and split at `__data_begin` into two
+appended sections: "delayimp" (code) and "delaydat" (writable data, with the rebuilt
+import directory and an informational delay-load directory). IAT slots get base
+relocations, as they now hold absolute addresses. Entries of delayed modules are removed
+from the bound import directory, as the loader would load them to validate the bindings.
+"delaydat" starts with the replaced directories and IAT values, so that processing the
+DLL again can restore the imports and drop both sections.
+*/
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Bind.h"
+#include "common.h"
+#include "Imports.h"
+#include "PEView.h"
+
+namespace PElib
+{
+
+class DelayLoadConversion
+{
+	PEEdit& pe;
+	std::vector<ImportedModule> kept;
+	std::vector<ImportedModule> delayed;
+	// Bound import directory without delayed modules (and modules bound through them).
+	bool had_bound_imports;
+	std::vector<BoundImport> bound;
+	std::vector<std::string> unbound;
+
+	bool IsDelayed(const std::string& name) const;
+
+public:
+	// Fails if any of `modules` isn't imported.
+	DelayLoadConversion(PEEdit& pe, const std::vector<std::string>& modules);
+
+	// Code to be assembled after delay_load.asm, at an RVA aligned to SectionAlignment.
+	std::string Source() const;
+	// Adds sections with assembled code and redirects the image to them. IAT slots which
+	// need base relocations are appended to `fixups`.
+	void Apply(RVA rva, const std::string& code, const std::map<std::string, uint>& labels,
+	           std::vector<RVA>* fixups);
+	// Number of imports which are now delay-loaded.
+	uint DelayedImports() const;
+};
+
+// Undoes the conversion done by a previous run, using section `data_index` ("delaydat"),
+// which is left for the caller to remove along with "delayimp". IAT slots whose base
+// relocations have to go are appended to `removed_fixups`. Returns the number of restored
+// imports.
+uint RestoreDelayLoad(PEEdit& pe, int data_index, std::vector<RVA>* removed_fixups);
+
+}
@@ -0,0 +1,194 @@
+#include "Delta.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+using std::fstream;
+using std::ios;
+using std::ofstream;
+using std::string;
+using std::vector;
+using std::wstring;
+
+namespace PElib
+{
+
+static const char delta_magic[8] = { 'D', 'L', 'L', 'D', 'E', 'L', 'T', 'A' };
+static const uint delta_version = 1;
+
+#pragma pack(push, 1)
+struct DeltaHeader
+{
+	char magic[8];
+	uint version;
+	uint record_count;
+	ull input_size;
+	ull output_size;
+	ull input_hash;
+	ull output_hash;
+};
+
+struct DeltaRecord
+{
+	ull offset;
+	uint length;
+};
+#pragma pack(pop)
+
+// Unchanged runs shorter than this are included in the surrounding record, as starting
+// a new record would cost more than that.
+static const size_t min_gap = sizeof(DeltaRecord) + 4;
+
+struct ParsedRecord
+{
+	ull offset;
+	uint length;
+	const char* data;
+};
+
+static DeltaHeader parse_delta(const string& delta, vector<ParsedRecord>* records)
+{
+	DeltaHeader header;
+	if (delta.size() < sizeof(header))
+		fatal_error("Delta file is too short");
+	memcpy(&header, delta.data(), sizeof(header));
+	if (memcmp(header.magic, delta_magic, sizeof(delta_magic)) != 0)
+		fatal_error("Not a delta file");
+	if (header.version != delta_version)
+		fatal_error("Unsupported delta version: %d", header.version);
+
+	size_t pos = sizeof(header);
+	for (uint i = 0; i < header.record_count; i++)
+	{
+		DeltaRecord record;
+		if (delta.size() - pos < sizeof(record))
+			fatal_error("Truncated delta file");
+		memcpy(&record, delta.data() + pos, sizeof(record));
+		pos += sizeof(record);
+		if (delta.size() - pos < record.length
+			|| record.offset > header.output_size
+			|| record.length > header.output_size - record.offset)
+		{
+			fatal_error("Corrupted delta record #%d", i);
+		}
+		records->push_back(ParsedRecord{ record.offset, record.length, delta.data() + pos });
+		pos += record.length;
+	}
+	return header;
+}
+
+ull Hash64(const string& data)
+{
+	ull hash = 0xcbf29ce484222325ull;
+	for (unsigned char c : data)
+	{
+		hash ^= c;
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+string MakeDelta(const string& input, const string& output)
+{
+	DeltaHeader header;
+	memcpy(header.magic, delta_magic, sizeof(delta_magic));
+	header.version = delta_version;
+	header.record_count = 0;
+	header.input_size = input.size();
+	header.output_size = output.size();
+	header.input_hash = Hash64(input);
+	header.output_hash = Hash64(output);
+
+	string res((const char*)&header, sizeof(header));
+	auto emit = [&](size_t begin, size_t end)
+	{
+		DeltaRecord record = { begin, (uint)(end - begin) };
+		res.append((const char*)&record, sizeof(record));
+		res.append(output, begin, end - begin);
+		header.record_count++;
+	};
+
+	size_t common = std::min(input.size(), output.size());
+	bool tail_done = output.size() <= common;
+	size_t i = 0;
+	while (i < common)
+	{
+		if (input[i] == output[i])
+		{
+			i++;
+			continue;
+		}
+		// Extend the record until a long enough unchanged run is found.
+		size_t begin = i;
+		size_t end = i + 1;
+		for (i = end; i < common && i - end < min_gap; i++)
+			if (input[i] != output[i])
+				end = i + 1;
+		if (!tail_done && common - end < min_gap)
+		{
+			// Appended data follows closely, so merge it into this record.
+			end = output.size();
+			tail_done = true;
+		}
+		emit(begin, end);
+	}
+	if (!tail_done)
+		emit(common, output.size());
+
+	memcpy(&res[0], &header, sizeof(header));
+	return res;
+}
+
+string ApplyDelta(const string& input, const string& delta)
+{
+	vector<ParsedRecord> records;
+	auto header = parse_delta(delta, &records);
+	if (input.size() != header.input_size || Hash64(input) != header.input_hash)
+		fatal_error("Delta doesn't match the input file");
+
+	string output = input;
+	output.resize((size_t)header.output_size);
+	for (const auto& record : records)
+		memcpy(&output[(size_t)record.offset], record.data, record.length);
+	if (Hash64(output) != header.output_hash)
+		fatal_error("Patched file doesn't match the expected output");
+	return output;
+}
+
+void ApplyDeltaToFile(const wstring& path, const string& delta)
+{
+	string input = read_whole_file(path);
+	// Verify everything in memory first, so a mismatch leaves the file untouched.
+	string output = ApplyDelta(input, delta);
+
+	if (output.size() < input.size())
+	{
+		// Shrinking a file can't be done portably with fstreams, but it's a rare case.
+		ofstream f(native_path(path), ios::binary | ios::trunc);
+		if (f.fail())
+			fatal_error("Cannot open file: %ls", path.c_str());
+		f.write(output.data(), output.size());
+		f.close();
+		if (f.fail())
+			fatal_error("Cannot write file: %ls", path.c_str());
+		return;
+	}
+
+	vector<ParsedRecord> records;
+	parse_delta(delta, &records);
+	fstream f(native_path(path), ios::binary | ios::in | ios::out);
+	if (f.fail())
+		fatal_error("Cannot open file: %ls", path.c_str());
+	for (const auto& record : records)
+	{
+		f.seekp(record.offset);
+		f.write(record.data, record.length);
+	}
+	f.close();
+	if (f.fail())
+		fatal_error("Cannot write file: %ls", path.c_str());
+}
+
+}
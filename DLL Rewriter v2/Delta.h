@@ -0,0 +1,38 @@
+/*
+Compact binary patches turning one file into another, used to ship rewritten DLLs without
+shipping whole images.
+
+Patch format (all integers are little-endian):
+	char magic[8];     // "DLLDELTA"
+	uint version;      // 1
+	uint record_count;
+	ull input_size;
+	ull output_size;
+	ull input_hash;    // FNV-1a (64-bit) of the whole input
+	ull output_hash;   // FNV-1a (64-bit) of the whole output
+	record_count records, sorted by offset:
+		ull offset;
+		uint length;
+		char data[length];
+
+Hashes are meant to catch applying a patch to the wrong file, they aren't cryptographic.
+*/
+
+#pragma once
+
+#include <string>
+
+#include "common.h"
+
+namespace PElib
+{
+
+ull Hash64(const std::string& data);
+std::string MakeDelta(const std::string& input, const std::string& output);
+// Turns `input` into the output described by `delta`, verifying both hashes.
+std::string ApplyDelta(const std::string& input, const std::string& delta);
+// Patches file in place. Only changed ranges are written (unless the file has to shrink).
+// The file is left untouched if any of the hashes doesn't match.
+void ApplyDeltaToFile(const std::wstring& path, const std::string& delta);
+
+}
@@ -0,0 +1,233 @@
+#include "Detour.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Reloc.h"
+#include "X86Decoder.h"
+
+using std::map;
+using std::min;
+using std::string;
+using std::vector;
+
+namespace PElib
+{
+
+static const uint jump_size = 5;     // E9 rel32
+static const uint max_prologue = 32; // Bytes read for decoding, enough for 4 + one instruction
+static const uint trampoline_alignment = 16;
+
+static void put_dword(string& out, uint value)
+{
+	out.append((const char*)&value, sizeof(value));
+}
+
+DetourBuilder::DetourBuilder(const PEEdit& pe, RVA rva, const vector<RVA>& functions)
+	: base(rva)
+{
+	vector<uint> entry_points;
+	for (RVA function : functions)
+		entry_points.push_back(function.val);
+	std::sort(entry_points.begin(), entry_points.end());
+	entry_points.erase(std::unique(entry_points.begin(), entry_points.end()), entry_points.end());
+
+	vector<uint> fixups;
+	for (const auto& block : ParseRelocations(pe))
+		for (ushort entry : block.entries)
+			if ((entry >> 12) == pe_rel_based_highlow)
+				fixups.push_back(block.page.val + (entry & 0xFFF));
+	std::sort(fixups.begin(), fixups.end());
+
+	for (uint function : entry_points)
+		Build(pe, RVA{ function }, entry_points, fixups);
+}
+
+void DetourBuilder::Build(const PEEdit& pe, RVA function, const vector<uint>& entry_points,
+                          const vector<uint>& fixups)
+{
+	uint fn = function.val;
+	uint available = 0;
+	for (uint i = 0; i < pe.SectionCount(); i++)
+	{
+		const auto& header = pe.SectionHeader(i);
+		if (header.VirtualAddress <= fn && fn < header.VirtualAddress + header.SizeOfRawData)
+			available = min(max_prologue, header.VirtualAddress + header.SizeOfRawData - fn);
+	}
+	if (!available)
+	{
+		failures[fn] = "not backed by file data";
+		return;
+	}
+	string bytes = pe.Read(function, available);
+	auto data = (const uchar*)bytes.data();
+
+	// Trampoline code, with rel32 displacements filled in at the end, once targets are known.
+	string out;
+	vector<std::pair<uint, uint>> branches; // Offset in `out` -> target RVA
+	vector<RVA> moved, copied;
+	uint pos = 0;
+	bool ends_flow = false;
+	while (pos < jump_size)
+	{
+		auto insn = DecodeX86(data + pos, available - pos);
+		if (!insn.length)
+		{
+			failures[fn] = format("can't decode instruction at +%x", pos);
+			return;
+		}
+		if (insn.ends_flow && pos + insn.length < jump_size)
+		{
+			failures[fn] = "function is shorter than a jump";
+			return;
+		}
+		ends_flow = insn.ends_flow;
+
+		// Absolute addresses keep their relocations, just at the new place.
+		uint out_insn = out.size();
+		for (auto it = std::lower_bound(fixups.begin(), fixups.end(), fn + pos);
+		     it != fixups.end() && *it < fn + pos + insn.length; ++it)
+		{
+			if (*it + sizeof(uint) > fn + pos + insn.length || insn.rel_size)
+			{
+				failures[fn] = format("unexpected relocation at +%x", *it - fn);
+				return;
+			}
+			moved.push_back(RVA{ *it });
+			copied.push_back(RVA{ base.val + out_insn + (*it - fn - pos) });
+		}
+
+		const uchar* insn_data = data + pos;
+		if (!insn.rel_size)
+			out.append((const char*)insn_data, insn.length);
+		else
+		{
+			uchar opcode = insn_data[insn.opcode_offset];
+			int disp;
+			if (insn.rel_size == 1)
+				disp = (signed char)insn_data[insn.rel_offset];
+			else if (insn.rel_size == 4)
+				memcpy(&disp, insn_data + insn.rel_offset, sizeof(disp));
+			else
+			{
+				failures[fn] = format("16-bit relative branch at +%x", pos);
+				return;
+			}
+			if (!insn.two_byte && opcode >= 0xE0 && opcode <= 0xE3)
+			{
+				failures[fn] = format("loop/jcxz at +%x", pos);
+				return;
+			}
+			uint target = fn + pos + insn.length + disp;
+
+			// Prefixes (e.g. branch hints) are kept. Short branches become near ones.
+			out.append((const char*)insn_data, insn.opcode_offset);
+			if (insn.rel_size == 4)
+				out.append((const char*)insn_data + insn.opcode_offset,
+				           insn.rel_offset - insn.opcode_offset);
+			else if (opcode == 0xEB)
+				out += '\xE9';
+			else
+			{
+				out += '\x0F';
+				out += (char)(opcode + 0x10); // 7x -> 0F 8x
+			}
+			branches.push_back({ (uint)out.size(), target });
+			put_dword(out, 0);
+		}
+		pos += insn.length;
+	}
+
+	for (const auto& branch : branches)
+		if (fn <= branch.second && branch.second < fn + pos)
+		{
+			failures[fn] = "branch into moved bytes";
+			return;
+		}
+	auto next = std::upper_bound(entry_points.begin(), entry_points.end(), fn);
+	if (next != entry_points.end() && *next < fn + pos)
+	{
+		failures[fn] = format("moved bytes overlap function at %08x", *next);
+		return;
+	}
+
+	if (!ends_flow)
+	{
+		out += '\xE9';
+		branches.push_back({ (uint)out.size(), fn + pos });
+		put_dword(out, 0);
+	}
+	uint trampoline = base.val + code.size();
+	for (const auto& branch : branches)
+	{
+		uint disp = branch.second - (trampoline + branch.first + sizeof(uint));
+		memcpy(&out[branch.first], &disp, sizeof(disp));
+	}
+	for (RVA& copy : copied)
+		copy.val += code.size();
+
+	code += out;
+	code.resize(align_up(code.size(), trampoline_alignment), '\xCC');
+	detours[fn] = Detour{ function, RVA{ trampoline }, pos };
+	moved_fixups.insert(moved_fixups.end(), moved.begin(), moved.end());
+	new_fixups.insert(new_fixups.end(), copied.begin(), copied.end());
+}
+
+const Detour* DetourBuilder::Find(RVA function) const
+{
+	auto it = detours.find(function.val);
+	return it == detours.end() ? nullptr : &it->second;
+}
+
+const map<uint, Detour>& DetourBuilder::Detours() const
+{
+	return detours;
+}
+
+const map<uint, string>& DetourBuilder::Failures() const
+{
+	return failures;
+}
+
+void DetourBuilder::AddSection(PEEdit& pe) const
+{
+	if (code.empty())
+		return;
+	if (pe.NextFreeRVA().val != base.val)
+		fatal_error("Trampolines were built for RVA=%08x, but the next free one is %08x",
+		            base.val, pe.NextFreeRVA().val);
+	pe.AddSection("detours",
+	              base,
+	              align_up(code.size(), pe.PeHeader().OptionalHeader.SectionAlignment),
+	              code,
+	              pe_scn_mem_read | pe_scn_mem_execute);
+}
+
+void DetourBuilder::PatchFunctions(PEEdit& pe, const map<uint, uint>& destinations) const
+{
+	for (const auto& it : detours)
+	{
+		const auto& detour = it.second;
+		auto dest = destinations.find(detour.function.val);
+		if (dest == destinations.end())
+			fatal_error("No destination for detoured function at %08x", detour.function.val);
+		// Leftovers of moved instructions are never executed, fill them with int3.
+		string patch(detour.moved, '\xCC');
+		patch[0] = '\xE9';
+		uint disp = dest->second - (detour.function.val + jump_size);
+		memcpy(&patch[1], &disp, sizeof(disp));
+		pe.Patch(detour.function, patch.data(), patch.size());
+	}
+}
+
+const vector<RVA>& DetourBuilder::MovedFixups() const
+{
+	return moved_fixups;
+}
+
+const vector<RVA>& DetourBuilder::TrampolineFixups() const
+{
+	return new_fixups;
+}
+
+}
@@ -0,0 +1,65 @@
+/*
+Inline detours. The first instructions of a function (at least 5 bytes) are moved to
+a trampoline, with relative branches fixed up, followed by a jump back to the rest of
+the function. The function start is then overwritten with a `jmp` to the wrapper, which
+calls the trampoline instead of the original function. This way calls from inside of
+the DLL, which don't go through the export table, are redirected as well.
+
+Prologues which can't be moved safely (undecodable instructions, functions shorter than
+a jump, branches back into the moved bytes, loop/jcxz, another function's entry point
+inside the moved bytes) are reported and left alone. Jumps from the rest of the function
+back into its first bytes can't be detected.
+*/
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "PElib.h"
+#include "PEView.h"
+
+namespace PElib
+{
+
+struct Detour
+{
+	RVA function;
+	RVA trampoline;
+	uint moved; // Number of prologue bytes moved to the trampoline
+};
+
+class DetourBuilder
+{
+	RVA base;
+	std::string code;
+	std::map<uint, Detour> detours;       // Keyed by function RVA
+	std::map<uint, std::string> failures; // Function RVA -> reason
+	std::vector<RVA> moved_fixups;        // Fixups inside moved bytes, dropped...
+	std::vector<RVA> new_fixups;          // ...and their copies in trampolines
+
+	void Build(const PEEdit& pe, RVA function, const std::vector<uint>& entry_points,
+	           const std::vector<uint>& fixups);
+
+public:
+	// Builds trampolines for `functions` (duplicates are fine), to be placed at `rva`.
+	DetourBuilder(const PEEdit& pe, RVA rva, const std::vector<RVA>& functions);
+
+	// Returns nullptr if the function couldn't be detoured.
+	const Detour* Find(RVA function) const;
+	const std::map<uint, Detour>& Detours() const;
+	const std::map<uint, std::string>& Failures() const;
+
+	// Adds section with trampolines. It has to be the next section added to `pe`.
+	void AddSection(PEEdit& pe) const;
+	// Overwrites start of every detoured function with a jump to `destinations[function]`.
+	void PatchFunctions(PEEdit& pe, const std::map<uint, uint>& destinations) const;
+	// Relocations of moved bytes have to be dropped and added for the trampolines instead
+	// (see AddRelocations()).
+	const std::vector<RVA>& MovedFixups() const;
+	const std::vector<RVA>& TrampolineFixups() const;
+};
+
+}
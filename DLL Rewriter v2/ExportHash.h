@@ -0,0 +1,143 @@
+/*
+Minimal perfect hash of export names, stored in the "exphash" section by --export-hash,
+and a header-only resolver for it. Doesn't depend on Windows headers. All integers are
+little-endian.
+
+Layout (offsets are relative to the start of the section, so the table can be used both
+in a mapped module and in file data):
+	ExportHashHeader header;
+	uint32_t displacements[bucket_count];  at buckets_offset
+	ExportHashEntry entries[count];        at entries_offset
+	char strings[];                        at strings_offset, NUL-terminated names
+
+Lookup (hash and displace): h = ExportHashName(name), bucket b = ExportHashBucket(h),
+slot = ExportHashSlot(h, displacements[b]). Every name maps to a different slot, so
+a single string compare tells whether the name is there. Only named exports are included.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace PElib
+{
+
+#pragma pack(push, 1)
+struct ExportHashHeader
+{
+	char magic[8];           // "DLLRHASH"
+	uint32_t version;        // 1
+	uint32_t count;          // Number of entries (named exports)
+	uint32_t bucket_count;
+	uint32_t seed;
+	uint32_t buckets_offset;
+	uint32_t entries_offset;
+	uint32_t strings_offset;
+	uint32_t reserved[7];
+};
+
+struct ExportHashEntry
+{
+	uint32_t name_offset;    // From the start of the section
+	uint32_t name_length;    // Without the NUL
+	uint32_t ordinal;        // Biased ordinal, as passed to GetProcAddress
+	uint32_t rva;            // AddressOfFunctions entry (may point to a forwarder string)
+};
+#pragma pack(pop)
+
+static_assert(sizeof(ExportHashHeader) == 64, "ExportHashHeader has to be 64 bytes");
+static_assert(sizeof(ExportHashEntry) == 16, "ExportHashEntry has to be 16 bytes");
+
+// FNV-1a, with the seed mixed into the offset basis.
+inline uint64_t ExportHashName(const char* name, size_t length, uint32_t seed)
+{
+	uint64_t h = 0xCBF29CE484222325ull ^ seed;
+	for (size_t i = 0; i < length; i++)
+		h = (h ^ (uint8_t)name[i]) * 0x100000001B3ull;
+	return h;
+}
+
+// Finalizer from MurmurHash3, spreads all bits of `h` over the result.
+inline uint64_t ExportHashMix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDull;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+// Maps the top 32 bits to [0, range) with a multiplication instead of a division.
+inline uint32_t ExportHashReduce(uint64_t h, uint32_t range)
+{
+	return (uint32_t)(((h >> 32) * range) >> 32);
+}
+
+inline uint32_t ExportHashBucket(uint64_t h, uint32_t bucket_count)
+{
+	return ExportHashReduce(ExportHashMix(h), bucket_count);
+}
+
+inline uint32_t ExportHashSlot(uint64_t h, uint32_t displacement, uint32_t count)
+{
+	return ExportHashReduce(ExportHashMix(h ^ (displacement * 0x9E3779B97F4A7C15ull)), count);
+}
+
+class ExportHashTable
+{
+	const char* base;
+	ExportHashHeader header;
+	bool valid;
+
+public:
+	// `section` points to the start of the "exphash" section, `size` is its size.
+	ExportHashTable(const void* section, size_t size)
+		: base((const char*)section), valid(false)
+	{
+		if (size < sizeof(header))
+			return;
+		memcpy(&header, base, sizeof(header));
+		valid = memcmp(header.magic, "DLLRHASH", sizeof(header.magic)) == 0
+			&& header.version == 1
+			&& header.count && header.bucket_count
+			&& header.buckets_offset + (uint64_t)header.bucket_count * sizeof(uint32_t) <= size
+			&& header.entries_offset + (uint64_t)header.count * sizeof(ExportHashEntry) <= size
+			&& header.strings_offset <= size;
+	}
+
+	bool Valid() const { return valid; }
+	uint32_t Size() const { return valid ? header.count : 0; }
+
+	// Returns nullptr if there is no export with this name.
+	const ExportHashEntry* Find(const char* name, size_t length) const
+	{
+		if (!valid)
+			return nullptr;
+		uint64_t h = ExportHashName(name, length, header.seed);
+		uint32_t displacement;
+		memcpy(&displacement,
+		       base + header.buckets_offset
+		            + ExportHashBucket(h, header.bucket_count) * sizeof(uint32_t),
+		       sizeof(displacement));
+		auto entry = (const ExportHashEntry*)(base + header.entries_offset)
+			+ ExportHashSlot(h, displacement, header.count);
+		if (entry->name_length != length || memcmp(base + entry->name_offset, name, length) != 0)
+			return nullptr;
+		return entry;
+	}
+
+	const ExportHashEntry* Find(const char* name) const
+	{
+		return Find(name, strlen(name));
+	}
+
+	const char* Name(const ExportHashEntry& entry) const
+	{
+		return base + entry.name_offset;
+	}
+};
+
+}
@@ -0,0 +1,127 @@
+#include "ExportHashBuilder.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "ExportHash.h"
+
+using std::string;
+using std::vector;
+
+namespace PElib
+{
+
+static const char hash_magic[8] = { 'D', 'L', 'L', 'R', 'H', 'A', 'S', 'H' };
+static const uint32_t hash_version = 1;
+static const uint32_t keys_per_bucket = 4;
+static const uint32_t max_seeds = 16;
+// Enough for the last single-key buckets, which look for the last free slots.
+static const uint32_t max_displacement = 1u << 22;
+
+// Finds a displacement for every bucket, biggest buckets first (hash and displace).
+// Returns false if some bucket can't be placed.
+static bool place(const vector<uint64_t>& hashes, uint32_t bucket_count,
+                  vector<uint32_t>* displacements, vector<uint32_t>* slots)
+{
+	uint32_t count = hashes.size();
+	vector<vector<uint32_t>> buckets(bucket_count);
+	for (uint32_t i = 0; i < count; i++)
+		buckets[ExportHashBucket(hashes[i], bucket_count)].push_back(i);
+	vector<uint32_t> order(bucket_count);
+	for (uint32_t i = 0; i < bucket_count; i++)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+	{
+		return buckets[a].size() > buckets[b].size();
+	});
+
+	vector<bool> taken(count, false);
+	displacements->assign(bucket_count, 0);
+	slots->assign(count, 0);
+	vector<uint32_t> candidate;
+	for (uint32_t bucket : order)
+	{
+		const auto& keys = buckets[bucket];
+		if (keys.empty())
+			break;
+		uint32_t d = 0;
+		for (; d < max_displacement; d++)
+		{
+			candidate.clear();
+			for (uint32_t key : keys)
+			{
+				uint32_t slot = ExportHashSlot(hashes[key], d, count);
+				if (taken[slot]
+					|| std::find(candidate.begin(), candidate.end(), slot) != candidate.end())
+					break;
+				candidate.push_back(slot);
+			}
+			if (candidate.size() == keys.size())
+				break;
+		}
+		if (d == max_displacement)
+			return false;
+		(*displacements)[bucket] = d;
+		for (size_t i = 0; i < keys.size(); i++)
+		{
+			taken[candidate[i]] = true;
+			(*slots)[keys[i]] = candidate[i];
+		}
+	}
+	return true;
+}
+
+string BuildExportHash(const vector<ExportHashKey>& keys)
+{
+	if (keys.empty())
+		return "";
+	uint32_t count = keys.size();
+	uint32_t bucket_count = (count + keys_per_bucket - 1) / keys_per_bucket;
+
+	vector<uint64_t> hashes(count);
+	vector<uint32_t> displacements, slots;
+	uint32_t seed = 0;
+	for (;; seed++)
+	{
+		if (seed == max_seeds)
+			return "";
+		for (uint32_t i = 0; i < count; i++)
+			hashes[i] = ExportHashName(keys[i].name.data(), keys[i].name.size(), seed);
+		if (place(hashes, bucket_count, &displacements, &slots))
+			break;
+	}
+
+	ExportHashHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, hash_magic, sizeof(header.magic));
+	header.version = hash_version;
+	header.count = count;
+	header.bucket_count = bucket_count;
+	header.seed = seed;
+	header.buckets_offset = sizeof(header);
+	header.entries_offset = header.buckets_offset + bucket_count * sizeof(uint32_t);
+	header.strings_offset = header.entries_offset + count * sizeof(ExportHashEntry);
+	size_t strings_size = 0;
+	for (const auto& key : keys)
+		strings_size += key.name.size() + 1;
+
+	string res(header.strings_offset + strings_size, '\0');
+	char* out = &res[0];
+	memcpy(out, &header, sizeof(header));
+	memcpy(out + header.buckets_offset, displacements.data(), bucket_count * sizeof(uint32_t));
+	uint32_t str_pos = header.strings_offset;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		ExportHashEntry entry;
+		entry.name_offset = str_pos;
+		entry.name_length = keys[i].name.size();
+		entry.ordinal = keys[i].ordinal;
+		entry.rva = keys[i].rva;
+		memcpy(out + header.entries_offset + slots[i] * sizeof(entry), &entry, sizeof(entry));
+		memcpy(out + str_pos, keys[i].name.c_str(), keys[i].name.size() + 1);
+		str_pos += keys[i].name.size() + 1;
+	}
+	return res;
+}
+
+}
@@ -0,0 +1,26 @@
+/*
+Builds the minimal perfect hash table read by ExportHash.h. Doesn't depend on Windows
+headers, so benchmarks can use it too.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace PElib
+{
+
+struct ExportHashKey
+{
+	std::string name;
+	uint32_t ordinal;
+	uint32_t rva;
+};
+
+// Returns contents of the "exphash" section. Empty if there are no keys or (not expected
+// in practice) no seed gives a perfect hash.
+std::string BuildExportHash(const std::vector<ExportHashKey>& keys);
+
+}
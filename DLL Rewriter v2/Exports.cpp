@@ -0,0 +1,299 @@
+#include "Exports.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "common.h"
+#include "ExportHashBuilder.h"
+
+using std::string;
+using std::vector;
+
+namespace PElib
+{
+
+ExportIndex::ExportIndex(const PEView& pe)
+	: names_sorted(true)
+{
+	memset(&directory, 0, sizeof(directory));
+	const auto& exports_dir_entry = pe.Directory(pe_directory_export);
+	if (!exports_dir_entry.VirtualAddress || !exports_dir_entry.Size)
+		return; // No exports
+	if (exports_dir_entry.Size < sizeof(PeExportDirectory))
+		fatal_error("Invalid export table size!");
+
+	// Load PeExportDirectory struct from in-memory file data
+	auto rva = RVA{ exports_dir_entry.VirtualAddress };
+	const auto& section = pe.SectionFromRVA(rva);
+	if (section.SizeOfRawData - (rva.val - section.VirtualAddress) < sizeof(directory))
+	{
+		// Export table crosses section boundary or file data,
+		// we're skipping this case for simplicity.
+		fatal_error("Unsupported export table location");
+	}
+	memcpy(&directory, pe.Pointer(rva, sizeof(directory)), sizeof(directory));
+	dll_name = directory.Name ? pe.ReadString(RVA{ directory.Name }) : "";
+
+	auto functions = (const uint*)pe.Pointer(RVA{ directory.AddressOfFunctions },
+	                                         directory.NumberOfFunctions * sizeof(uint));
+	exports.resize(directory.NumberOfFunctions);
+	for (uint i = 0; i < directory.NumberOfFunctions; i++)
+	{
+		auto& exp = exports[i];
+		exp.ordinal = directory.Base + i;
+		exp.rva = RVA{ functions[i] };
+		// Forwarded exports point to a string inside of the export directory.
+		if (exports_dir_entry.VirtualAddress <= exp.rva.val
+			&& exp.rva.val < exports_dir_entry.VirtualAddress + exports_dir_entry.Size)
+		{
+			exp.forwarder = pe.ReadString(exp.rva);
+		}
+	}
+
+	if (!directory.NumberOfNames)
+		return;
+	auto name_rvas = (const uint*)pe.Pointer(RVA{ directory.AddressOfNames },
+	                                         directory.NumberOfNames * sizeof(uint));
+	auto ordinals = (const ushort*)pe.Pointer(RVA{ directory.AddressOfNameOrdinals },
+	                                        directory.NumberOfNames * sizeof(ushort));
+	// Names are copied into one pool in table order. The loader needs them sorted, so they
+	// usually are, and sorting (and removing duplicates) is needed only for broken tables.
+	size_t pool_size = 0;
+	for (uint i = 0; i < directory.NumberOfNames; i++)
+	{
+		size_t length;
+		pe.Image().StringAtRVA(name_rvas[i], &length);
+		pool_size += length + 1;
+	}
+	name_pool.reserve(pool_size);
+	names.reserve(directory.NumberOfNames);
+	const char* previous = nullptr;
+	for (uint i = 0; i < directory.NumberOfNames; i++)
+	{
+		if (ordinals[i] >= exports.size())
+			fatal_error("Export name ordinal out of range! (%d)", ordinals[i]);
+		size_t length;
+		const char* name = pe.Image().StringAtRVA(name_rvas[i], &length);
+		if (previous && strcmp(previous, name) >= 0)
+			names_sorted = false;
+		previous = name;
+		// Other names of the same export are aliases, they're only in `names`.
+		auto& exp = exports[ordinals[i]];
+		if (exp.name.empty())
+			exp.name.assign(name, length);
+		names.push_back(ExportName{ (uint)name_pool.size(), ordinals[i] });
+		name_pool.append(name, length + 1);
+	}
+	if (!names_sorted)
+	{
+		auto less = [this](const ExportName& a, const ExportName& b)
+		{
+			return strcmp(NameString(a), NameString(b)) < 0;
+		};
+		auto equal = [this](const ExportName& a, const ExportName& b)
+		{
+			return strcmp(NameString(a), NameString(b)) == 0;
+		};
+		std::stable_sort(names.begin(), names.end(), less);
+		names.erase(std::unique(names.begin(), names.end(), equal), names.end());
+	}
+}
+
+vector<ExportName>::const_iterator ExportIndex::LowerBound(const char* name) const
+{
+	return std::lower_bound(names.begin(), names.end(), name,
+	                        [this](const ExportName& a, const char* b)
+	                        {
+	                            return strcmp(NameString(a), b) < 0;
+	                        });
+}
+
+const string& ExportIndex::DllName() const
+{
+	return dll_name;
+}
+
+const PeExportDirectory& ExportIndex::Directory() const
+{
+	return directory;
+}
+
+const vector<Export>& ExportIndex::Exports() const
+{
+	return exports;
+}
+
+const Export& ExportIndex::operator[](uint index) const
+{
+	return exports[index];
+}
+
+uint ExportIndex::Size() const
+{
+	return exports.size();
+}
+
+bool ExportIndex::NamesSorted() const
+{
+	return names_sorted;
+}
+
+const vector<ExportName>& ExportIndex::Names() const
+{
+	return names;
+}
+
+const char* ExportIndex::NameString(const ExportName& name) const
+{
+	return name_pool.c_str() + name.offset;
+}
+
+const Export* ExportIndex::FindByName(const string& name) const
+{
+	auto it = LowerBound(name.c_str());
+	if (it == names.end() || NameString(*it) != name)
+		return nullptr;
+	return &exports[it->index];
+}
+
+const Export* ExportIndex::FindByOrdinal(uint ordinal) const
+{
+	if (ordinal < directory.Base || ordinal - directory.Base >= exports.size())
+		return nullptr;
+	return &exports[ordinal - directory.Base];
+}
+
+void ExportIndex::SetRVA(uint index, RVA rva)
+{
+	if (index >= exports.size())
+		fatal_error("Bad argument passed to %s! (index=%d)", __FUNCTION__, index);
+	exports[index].rva = rva;
+	exports[index].forwarder.clear();
+}
+
+void ExportIndex::Add(const Export& exp)
+{
+	if (exports.empty() && !directory.Base)
+		directory.Base = exp.ordinal;
+	if (exp.ordinal < directory.Base)
+		fatal_error("Ordinal %d is below the ordinal base (%d)", exp.ordinal, directory.Base);
+	uint index = exp.ordinal - directory.Base;
+	if (index >= exports.size())
+	{
+		uint old_size = exports.size();
+		exports.resize(index + 1);
+		for (uint i = old_size; i < exports.size(); i++)
+		{
+			exports[i].ordinal = directory.Base + i;
+			exports[i].rva = RVA{ 0 };
+		}
+	}
+	if (exports[index].rva.val || exports[index].IsForwarded())
+		fatal_error("Ordinal %d is already used", exp.ordinal);
+	if (!exp.name.empty())
+	{
+		auto it = LowerBound(exp.name.c_str());
+		if (it != names.end() && NameString(*it) == exp.name)
+			fatal_error("Export name \"%s\" is already used", exp.name.c_str());
+		names.insert(it, ExportName{ (uint)name_pool.size(), index });
+		name_pool.append(exp.name.c_str(), exp.name.size() + 1);
+	}
+	exports[index] = exp;
+}
+
+// Layout: PeExportDirectory, AddressOfFunctions, AddressOfNames, AddressOfNameOrdinals,
+// followed by a pool of strings (DLL name, forwarders, export names in sorted order).
+// `names` are already sorted the same way as strcmp() does, and have every alias.
+// Everything (including forwarder strings) lies inside of the directory, so that
+// the loader recognizes forwarders. Sizes are computed upfront, so the result is
+// allocated once.
+string ExportIndex::Build(RVA rva) const
+{
+	if (exports.size() > 0x10000)
+		fatal_error("Too many exports! (%zd)", exports.size());
+
+	size_t strings_size = dll_name.size() + 1;
+	for (const auto& exp : exports)
+		if (exp.IsForwarded())
+			strings_size += exp.forwarder.size() + 1;
+	for (const auto& name : names)
+		strings_size += strlen(NameString(name)) + 1;
+
+	uint functions_off = sizeof(PeExportDirectory);
+	uint names_off = functions_off + exports.size() * sizeof(uint);
+	uint ordinals_off = names_off + names.size() * sizeof(uint);
+	uint strings_off = ordinals_off + names.size() * sizeof(ushort);
+	string res(strings_off + strings_size, '\0');
+	char* out = &res[0];
+
+	auto dir = directory;
+	dir.Name = rva.val + strings_off;
+	dir.NumberOfFunctions = exports.size();
+	dir.NumberOfNames = names.size();
+	dir.AddressOfFunctions = rva.val + functions_off;
+	dir.AddressOfNames = rva.val + names_off;
+	dir.AddressOfNameOrdinals = rva.val + ordinals_off;
+	memcpy(out, &dir, sizeof(dir));
+
+	uint str_pos = strings_off;
+	auto put_string = [&](const char* str, size_t length) -> uint
+	{
+		uint pos = str_pos;
+		memcpy(out + pos, str, length + 1);
+		str_pos += length + 1;
+		return rva.val + pos;
+	};
+	put_string(dll_name.c_str(), dll_name.size());
+
+	auto functions = (uint*)(out + functions_off);
+	for (uint i = 0; i < exports.size(); i++)
+		functions[i] = exports[i].IsForwarded()
+			? put_string(exports[i].forwarder.c_str(), exports[i].forwarder.size())
+			: exports[i].rva.val;
+	auto name_rvas = (uint*)(out + names_off);
+	auto ordinals = (ushort*)(out + ordinals_off);
+	for (const auto& name : names)
+	{
+		const char* str = NameString(name);
+		*name_rvas++ = put_string(str, strlen(str));
+		*ordinals++ = (ushort)name.index;
+	}
+	return res;
+}
+
+void WriteExportDirectory(PEEdit& pe, const ExportIndex& exports)
+{
+	auto rva = pe.NextFreeRVA();
+	string data = exports.Build(rva);
+	pe.AddSection("exports",
+	              rva,
+	              align_up(data.size(), pe.PeHeader().OptionalHeader.SectionAlignment),
+	              data,
+	              pe_scn_cnt_initialized_data | pe_scn_mem_read);
+	pe.SetDirectory(pe_directory_export, rva, data.size());
+}
+
+uint WriteExportHash(PEEdit& pe, const ExportIndex& exports)
+{
+	vector<ExportHashKey> keys;
+	for (const auto& name : exports.Names())
+	{
+		const auto& exp = exports[name.index];
+		keys.push_back(ExportHashKey{ exports.NameString(name), exp.ordinal, exp.rva.val });
+	}
+	if (keys.empty())
+		return 0;
+	string data = BuildExportHash(keys);
+	if (data.empty())
+		fatal_error("Can't build a perfect hash of %zd export names", keys.size());
+
+	auto rva = pe.NextFreeRVA();
+	pe.AddSection("exphash",
+	              rva,
+	              align_up(data.size(), pe.PeHeader().OptionalHeader.SectionAlignment),
+	              data,
+	              pe_scn_cnt_initialized_data | pe_scn_mem_read);
+	return keys.size();
+}
+
+}
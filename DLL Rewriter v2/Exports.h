@@ -0,0 +1,77 @@
+/*
+`ExportIndex` is a parsed copy of the export directory of a PE file. It can be modified and
+serialized back into a new export directory.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "PElib.h"
+#include "PEView.h"
+
+namespace PElib
+{
+
+struct Export
+{
+	uint ordinal;          // Biased ordinal (index in AddressOfFunctions + Base)
+	RVA rva;               // 0 for unused entries
+	std::string name;      // First name, empty for exports by ordinal only (see Names())
+	std::string forwarder; // "MODULE.Function" or "MODULE.#ordinal", empty if not forwarded
+
+	bool IsForwarded() const { return !forwarder.empty(); }
+};
+
+struct ExportName
+{
+	uint offset; // Of the NUL-terminated name in the name pool of its ExportIndex
+	uint index;  // Of the export
+};
+
+class ExportIndex
+{
+	std::string dll_name;
+	PeExportDirectory directory;
+	std::vector<Export> exports; // Indexed the same way as AddressOfFunctions
+	std::string name_pool;
+	std::vector<ExportName> names; // Every name, including aliases, sorted by strcmp()
+	bool names_sorted;
+
+	// The first name not less than `name`.
+	std::vector<ExportName>::const_iterator LowerBound(const char* name) const;
+
+public:
+	ExportIndex(const PEView& pe);
+
+	const std::string& DllName() const;
+	const PeExportDirectory& Directory() const;
+	const std::vector<Export>& Exports() const;
+	const Export& operator[](uint index) const;
+	uint Size() const;
+	// Whether AddressOfNames is sorted, as required by the loader's binary search.
+	bool NamesSorted() const;
+	// Every export name, sorted like strcmp() does. Exports may have more than one name
+	// (aliases), `Export::name` holds only the first one.
+	const std::vector<ExportName>& Names() const;
+	const char* NameString(const ExportName& name) const;
+	// Returns nullptr if there is no such export.
+	const Export* FindByName(const std::string& name) const;
+	const Export* FindByOrdinal(uint ordinal) const;
+
+	void SetRVA(uint index, RVA rva);
+	// Adds a new export (possibly a forwarder) with ordinal not used by any other export.
+	void Add(const Export& exp);
+	// Serializes the whole export directory (with names sorted) as if it was placed at `rva`.
+	std::string Build(RVA rva) const;
+};
+
+// Places rebuilt export directory in a new section and points the export data directory to it.
+void WriteExportDirectory(PEEdit& pe, const ExportIndex& exports);
+// Adds "exphash" section with a perfect hash of export names (see ExportHash.h).
+// Returns the number of names in it.
+uint WriteExportHash(PEEdit& pe, const ExportIndex& exports);
+
+}
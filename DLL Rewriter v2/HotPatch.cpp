@@ -0,0 +1,202 @@
+#include "HotPatch.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "PEImage.h"
+
+using std::vector;
+
+namespace PElib
+{
+
+static const uint8_t jmp_short = 0xEB;
+static const uint8_t jmp_rel32 = 0xE9;
+static const uint8_t nop = 0x90;
+static const uint32_t spare_size = 5;
+// `jmp short $-5` at the entry, i.e. to the spare bytes.
+static const uint8_t patched_entry[2] = { jmp_short, (uint8_t)-(int8_t)(spare_size + 2) };
+
+const char* HotPatchStatusName(HotPatchStatus status)
+{
+	switch (status)
+	{
+	case HotPatchStatus::Ok:             return "ok";
+	case HotPatchStatus::NoSuchExport:   return "no such export";
+	case HotPatchStatus::BadLayout:      return "unexpected wrapper layout";
+	case HotPatchStatus::HookOutOfRange: return "hook out of range";
+	case HotPatchStatus::ProtectFailed:  return "cannot change memory protection";
+	}
+	return "unknown";
+}
+
+bool ReadLoadedWrappers(const void* base, vector<WrapperRecord>* records)
+{
+	// Headers are mapped at `base`, sections at their RVAs.
+	ByteView headers(base, sizeof(PeDosHeader));
+	const auto& dos = headers.At<PeDosHeader>(0);
+	if (dos.e_magic != pe_dos_signature || dos.e_lfanew < (int32_t)sizeof(dos))
+		return false;
+	const auto& nt = ByteView(base, dos.e_lfanew + sizeof(PeNtHeaders32)).At<PeNtHeaders32>(dos.e_lfanew);
+	if (nt.Signature != pe_nt_signature)
+		return false;
+	ByteView image(base, nt.OptionalHeader.SizeOfImage);
+	auto sections = image.Array<PeSectionHeader>(
+		dos.e_lfanew + offsetof(PeNtHeaders32, OptionalHeader) + nt.FileHeader.SizeOfOptionalHeader,
+		nt.FileHeader.NumberOfSections);
+	for (const auto& section : sections)
+	{
+		if (strncmp((const char*)section.Name, "wrappers", sizeof(section.Name)) != 0)
+			continue;
+		// The trailer ends raw data, which may have been padded with zeros (e.g. by
+		// --compact). The trailer itself usually ends with zeros too, so every end within
+		// the padding is tried instead of skipping them.
+		auto data = image.Sub(section.VirtualAddress, section.SizeOfRawData);
+		for (size_t end = data.Size(); end >= sizeof(WrappersTrailer)
+		     && end + nt.OptionalHeader.FileAlignment >= data.Size(); end--)
+		{
+			const auto& trailer = data.At<WrappersTrailer>(end - sizeof(WrappersTrailer));
+			if (memcmp(trailer.magic, wrappers_magic, sizeof(trailer.magic)) == 0
+				&& trailer.version == wrappers_version)
+			{
+				auto stored = image.Array<WrapperRecord>(trailer.records_rva, trailer.count);
+				records->assign(stored.begin(), stored.end());
+				return true;
+			}
+			if (data.Data()[end - 1])
+				return false;
+		}
+		return false;
+	}
+	return false;
+}
+
+// Makes code writable for the lifetime of the object.
+class WritableCode
+{
+	uint8_t* begin;
+	size_t size;
+#ifdef _WIN32
+	DWORD old_protection;
+#endif
+	bool ok;
+
+public:
+	WritableCode(uint8_t* address, size_t length)
+	{
+#ifdef _WIN32
+		begin = address;
+		size = length;
+		ok = VirtualProtect(begin, size, PAGE_EXECUTE_READWRITE, &old_protection) != 0;
+#else
+		size_t page = (size_t)sysconf(_SC_PAGESIZE);
+		begin = (uint8_t*)((uintptr_t)address & ~(uintptr_t)(page - 1));
+		size = address + length - begin;
+		ok = mprotect(begin, size, PROT_READ | PROT_WRITE | PROT_EXEC) == 0;
+#endif
+	}
+
+	~WritableCode()
+	{
+		if (!ok)
+			return;
+#ifdef _WIN32
+		DWORD unused;
+		VirtualProtect(begin, size, old_protection, &unused);
+		FlushInstructionCache(GetCurrentProcess(), begin, size);
+#else
+		mprotect(begin, size, PROT_READ | PROT_EXEC);
+		__builtin___clear_cache((char*)begin, (char*)begin + size);
+#endif
+	}
+
+	bool Ok() const { return ok; }
+};
+
+// Entries are 16-byte aligned, so this single store is atomic for instruction fetch too.
+static void store_entry(uint8_t* entry, const uint8_t instruction[2])
+{
+	uint16_t value;
+	memcpy(&value, instruction, sizeof(value));
+#ifdef _MSC_VER
+	InterlockedExchange16((volatile SHORT*)entry, (SHORT)value);
+#else
+	__atomic_store_n((uint16_t*)entry, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+HotPatcher::HotPatcher(void* base, const vector<WrapperRecord>& records)
+	: base((uint8_t*)base)
+{
+	for (const auto& record : records)
+		entries[record.index] = record.entry_rva;
+}
+
+HotPatchStatus HotPatcher::Apply(uint32_t index, const void* hook)
+{
+	auto it = entries.find(index);
+	if (it == entries.end())
+		return HotPatchStatus::NoSuchExport;
+	uint8_t* entry = base + it->second;
+	if (IsApplied(index))
+	{
+		auto status = Revert(index);
+		if (status != HotPatchStatus::Ok)
+			return status;
+	}
+
+	// The entry jumps back to `jmp <original>` and the spare bytes are nops, or a long
+	// jump left by a reverted patch.
+	uint8_t* spare = entry - spare_size;
+	uint8_t* target = entry + 2 + (int8_t)entry[1];
+	if ((uintptr_t)entry % 2 != 0 || entry[0] != jmp_short || target >= spare
+		|| target[0] != jmp_rel32)
+		return HotPatchStatus::BadLayout;
+	if (spare[0] != jmp_rel32)
+		for (uint32_t i = 0; i < spare_size; i++)
+			if (spare[i] != nop)
+				return HotPatchStatus::BadLayout;
+
+	int64_t distance = (intptr_t)hook - (intptr_t)entry;
+	if (distance != (int32_t)distance)
+		return HotPatchStatus::HookOutOfRange;
+	int32_t rel = (int32_t)distance;
+
+	WritableCode writable(spare, spare_size + 2);
+	if (!writable.Ok())
+		return HotPatchStatus::ProtectFailed;
+	spare[0] = jmp_rel32;
+	memcpy(spare + 1, &rel, sizeof(rel));
+	memcpy(&originals[index], entry, 2);
+	store_entry(entry, patched_entry);
+	return HotPatchStatus::Ok;
+}
+
+HotPatchStatus HotPatcher::Revert(uint32_t index)
+{
+	auto it = originals.find(index);
+	if (it == originals.end())
+		return entries.count(index) ? HotPatchStatus::Ok : HotPatchStatus::NoSuchExport;
+	uint8_t* entry = base + entries[index];
+	WritableCode writable(entry, 2);
+	if (!writable.Ok())
+		return HotPatchStatus::ProtectFailed;
+	uint8_t original[2];
+	memcpy(original, &it->second, sizeof(original));
+	store_entry(entry, original);
+	originals.erase(it);
+	return HotPatchStatus::Ok;
+}
+
+bool HotPatcher::IsApplied(uint32_t index) const
+{
+	return originals.count(index) != 0;
+}
+
+}
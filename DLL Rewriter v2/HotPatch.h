@@ -0,0 +1,59 @@
+/*
+Hot-patching of wrappers from short_jmp.asm in a live process. Every such wrapper has
+5 spare bytes (nops) right before its 16-byte aligned `entry_<index>`, whose only
+instruction is a 2-byte `jmp short`. Applying a patch writes `jmp <hook>` into the spare
+bytes, then replaces the entry's jump with `jmp short $-5` using a single aligned 2-byte
+store, so threads calling the export at the same time run either the old or the new
+code. Reverting stores the original 2 bytes back. Calls go through no extra indirection.
+
+Doesn't depend on Windows headers: code is made writable with VirtualProtect() on Windows
+and mprotect() elsewhere (where it's left readable and executable afterwards). Methods of
+one `HotPatcher` must not be called concurrently. Changing the hook of an applied patch
+reverts it first; the spare bytes are then rewritten, which is unsafe only for a thread
+that already took the old entry jump and hasn't executed the long jump yet.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "WrappersFormat.h"
+
+namespace PElib
+{
+
+enum class HotPatchStatus
+{
+	Ok,
+	NoSuchExport,
+	BadLayout,       // Not a short_jmp.asm wrapper, or patched by someone else
+	HookOutOfRange,  // Hook is more than 2 GB away from the wrapper
+	ProtectFailed,
+};
+
+const char* HotPatchStatusName(HotPatchStatus status);
+
+// Wrappers metadata of a module loaded at `base` (e.g. the HMODULE). Returns false if
+// it has no "wrappers" section with valid metadata.
+bool ReadLoadedWrappers(const void* base, std::vector<WrapperRecord>* records);
+
+class HotPatcher
+{
+	uint8_t* base;
+	std::map<uint32_t, uint32_t> entries;   // Export index -> entry RVA
+	std::map<uint32_t, uint16_t> originals; // Export index -> replaced entry instruction
+
+public:
+	// `base` is the module's load address, `records` come from its wrappers metadata.
+	HotPatcher(void* base, const std::vector<WrapperRecord>& records);
+
+	// Redirects calls of export `index` (in AddressOfFunctions) to `hook`.
+	HotPatchStatus Apply(uint32_t index, const void* hook);
+	// Restores the original wrapper. Reverting an export which isn't patched is a no-op.
+	HotPatchStatus Revert(uint32_t index);
+	bool IsApplied(uint32_t index) const;
+};
+
+}
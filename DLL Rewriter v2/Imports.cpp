@@ -0,0 +1,88 @@
+#include "Imports.h"
+
+#include <cstring>
+
+using std::string;
+using std::vector;
+
+namespace PElib
+{
+
+string ImportedModule::Symbol(const Import& import)
+{
+	return import.name.empty() ? format("#%d", import.ordinal) : import.name;
+}
+
+// Descriptors and thunks are read with `read(destination, rva, size)`. Names are read from
+// `pe`, as no pass changes them.
+template<typename Read>
+static vector<ImportedModule> parse_imports(const PEView& pe, const PeDataDirectory& import_dir_entry,
+                                            Read read)
+{
+	vector<ImportedModule> res;
+	if (!import_dir_entry.VirtualAddress || !import_dir_entry.Size)
+		return res; // No imports
+
+	for (uint desc_rva = import_dir_entry.VirtualAddress;; desc_rva += sizeof(PeImportDescriptor))
+	{
+		PeImportDescriptor desc;
+		read(&desc, RVA{ desc_rva }, sizeof(desc));
+		if (!desc.Name && !desc.FirstThunk)
+			break; // Terminating null descriptor
+
+		ImportedModule module;
+		module.name = pe.ReadString(RVA{ desc.Name });
+		module.descriptor_rva = RVA{ desc_rva };
+		module.descriptor = desc;
+		module.has_lookup_table = desc.OriginalFirstThunk != 0;
+		uint lookup_rva = module.has_lookup_table ? desc.OriginalFirstThunk : desc.FirstThunk;
+		// Without a lookup table, IAT of an already bound module holds VAs, not names.
+		bool names_lost = !module.has_lookup_table && desc.TimeDateStamp;
+		for (uint i = 0; !names_lost; i++)
+		{
+			uint thunk;
+			read(&thunk, RVA{ lookup_rva + i * (uint)sizeof(uint) }, sizeof(thunk));
+			if (!thunk)
+				break;
+			Import import;
+			import.iat_slot = RVA{ desc.FirstThunk + i * (uint)sizeof(uint) };
+			if (thunk & pe_ordinal_flag32)
+			{
+				import.ordinal = thunk & 0xFFFF;
+				import.hint = 0;
+				import.name_rva = RVA{ 0 };
+			}
+			else
+			{
+				import.ordinal = 0;
+				import.name_rva = RVA{ thunk };
+				import.hint = *(const ushort*)pe.Pointer(RVA{ thunk }, sizeof(ushort));
+				import.name = pe.ReadString(RVA{ thunk + (uint)sizeof(ushort) });
+			}
+			module.imports.push_back(import);
+		}
+		res.push_back(std::move(module));
+	}
+	return res;
+}
+
+vector<ImportedModule> ParseImports(const PEView& pe)
+{
+	auto read = [&pe](void* destination, RVA rva, uint size)
+	{
+		memcpy(destination, pe.Pointer(rva, size), size);
+	};
+	return parse_imports(pe, pe.Directory(pe_directory_import), read);
+}
+
+vector<ImportedModule> ParseImports(const PEEdit& pe)
+{
+	auto read = [&pe](void* destination, RVA rva, uint size)
+	{
+		memcpy(destination, pe.Read(rva, size).data(), size);
+	};
+	return parse_imports(pe.View(), pe.PeHeader().OptionalHeader.DataDirectory[pe_directory_import],
+	                     read);
+}
+
+}
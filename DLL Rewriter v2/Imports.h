@@ -0,0 +1,45 @@
+/*
+Parsed import directory of a PE file (32-bit thunks only).
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "PElib.h"
+#include "PEView.h"
+
+namespace PElib
+{
+
+struct Import
+{
+	std::string name; // Empty for imports by ordinal
+	uint ordinal;     // Valid only for imports by ordinal
+	uint hint;        // Valid only for imports by name
+	RVA name_rva;     // PeImportByName, 0 for imports by ordinal
+	RVA iat_slot;     // Address of the IAT entry, filled by the loader
+};
+
+struct ImportedModule
+{
+	std::string name;
+	RVA descriptor_rva;
+	PeImportDescriptor descriptor;
+	std::vector<Import> imports;
+	// False if the names were read from the IAT, because there is no
+	// OriginalFirstThunk array. Such modules can't be bound.
+	bool has_lookup_table;
+
+	// "Function" or "#ordinal", as accepted by ModuleCache::ResolveSymbol.
+	static std::string Symbol(const Import& import);
+};
+
+// Returns an empty vector if there is no import directory.
+std::vector<ImportedModule> ParseImports(const PEView& pe);
+// The same, but for the current (possibly rewritten) directory and IAT.
+std::vector<ImportedModule> ParseImports(const PEEdit& pe);
+
+}
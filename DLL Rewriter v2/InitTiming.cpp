@@ -0,0 +1,138 @@
+#include "InitTiming.h"
+
+#include <cstring>
+
+using std::string;
+using std::vector;
+
+namespace PElib
+{
+
+static const char timing_magic[8] = { 'D', 'L', 'L', 'R', 'I', 'N', 'I', 'T' };
+static const uint timing_version = 1;
+static const uint records_alignment = 64;
+// The array is NUL-terminated, this only guards against garbage.
+static const uint max_tls_callbacks = 0x1000;
+
+vector<InitCallback> FindInitCallbacks(const PEEdit& pe)
+{
+	vector<InitCallback> res;
+	const auto& optional = pe.PeHeader().OptionalHeader;
+	if (optional.AddressOfEntryPoint)
+		res.push_back(InitCallback{ InitCallbackKind::EntryPoint,
+		                            RVA{ optional.AddressOfEntryPoint }, RVA{ 0 } });
+
+	if (optional.NumberOfRvaAndSizes <= pe_directory_tls)
+		return res;
+	const auto& tls_dir = optional.DataDirectory[pe_directory_tls];
+	if (!tls_dir.VirtualAddress || !tls_dir.Size)
+		return res;
+	PeTlsDirectory32 tls;
+	string raw = pe.Read(RVA{ tls_dir.VirtualAddress }, sizeof(tls));
+	memcpy(&tls, raw.data(), sizeof(tls));
+	if (!tls.AddressOfCallBacks)
+		return res;
+	if (tls.AddressOfCallBacks < optional.ImageBase)
+		fatal_error("Bad TLS callback array address: %08x", tls.AddressOfCallBacks);
+	RVA slot{ tls.AddressOfCallBacks - optional.ImageBase };
+	for (uint i = 0;; i++, slot.val += sizeof(uint))
+	{
+		if (i == max_tls_callbacks)
+			fatal_error("TLS callback array at %08x isn't terminated", tls.AddressOfCallBacks);
+		uint va;
+		memcpy(&va, pe.Read(slot, sizeof(va)).data(), sizeof(va));
+		if (!va)
+			break;
+		if (va < optional.ImageBase)
+			fatal_error("Bad TLS callback address: %08x", va);
+		res.push_back(InitCallback{ InitCallbackKind::Tls, RVA{ va - optional.ImageBase }, slot });
+	}
+	return res;
+}
+
+uint InitTimingRecordsOffset(uint callback_count)
+{
+	return align_up(sizeof(InitTimingHeader) + callback_count * sizeof(InitTimingCallback),
+	                records_alignment);
+}
+
+uint InitTimingSize(uint callback_count)
+{
+	return InitTimingRecordsOffset(callback_count)
+		+ callback_count * init_timing_reasons * sizeof(InitTimingRecord);
+}
+
+string BuildInitTiming(const vector<InitCallback>& callbacks)
+{
+	InitTimingHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, timing_magic, sizeof(header.magic));
+	header.version = timing_version;
+	header.callback_count = callbacks.size();
+	header.reason_count = init_timing_reasons;
+	header.record_size = sizeof(InitTimingRecord);
+	header.callbacks_offset = sizeof(header);
+	header.records_offset = InitTimingRecordsOffset(callbacks.size());
+
+	string res(header.callbacks_offset + callbacks.size() * sizeof(InitTimingCallback), '\0');
+	memcpy(&res[0], &header, sizeof(header));
+	for (size_t i = 0; i < callbacks.size(); i++)
+	{
+		InitTimingCallback callback = { callbacks[i].kind, callbacks[i].original.val,
+		                                callbacks[i].slot.val, 0 };
+		memcpy(&res[header.callbacks_offset + i * sizeof(callback)], &callback, sizeof(callback));
+	}
+	return res;
+}
+
+// Entry point lives in the headers, TLS callbacks in the array (as VAs, which already
+// have base relocations).
+static void set_callback(PEEdit& pe, const InitCallback& callback, RVA target)
+{
+	if (callback.kind == InitCallbackKind::EntryPoint)
+	{
+		pe.PeHeader().OptionalHeader.AddressOfEntryPoint = target.val;
+		return;
+	}
+	uint va = pe.PeHeader().OptionalHeader.ImageBase + target.val;
+	pe.Patch(callback.slot, &va, sizeof(va));
+}
+
+string InitThunkLabel(uint index)
+{
+	return format("__init%d_thunk", index);
+}
+
+void PatchInitCallbacks(PEEdit& pe, const vector<InitCallback>& callbacks,
+                        const vector<RVA>& thunks)
+{
+	if (thunks.size() != callbacks.size())
+		fatal_error("Bad argument passed to %s! (%zd thunks for %zd callbacks)", __FUNCTION__,
+		            thunks.size(), callbacks.size());
+	for (size_t i = 0; i < callbacks.size(); i++)
+		set_callback(pe, callbacks[i], thunks[i]);
+}
+
+uint RestoreInitCallbacks(PEEdit& pe, uint section)
+{
+	RVA rva{ pe.SectionHeader(section).VirtualAddress };
+	InitTimingHeader header;
+	memcpy(&header, pe.Read(rva, sizeof(header)).data(), sizeof(header));
+	if (memcmp(header.magic, timing_magic, sizeof(header.magic)) != 0
+		|| header.version != timing_version)
+		fatal_error("Section 'inittime' already exists, but it wasn't created by this tool");
+	if (!header.callback_count)
+		return 0;
+	string raw = pe.Read(RVA{ rva.val + header.callbacks_offset },
+	                     header.callback_count * sizeof(InitTimingCallback));
+	for (uint i = 0; i < header.callback_count; i++)
+	{
+		InitTimingCallback saved;
+		memcpy(&saved, &raw[i * sizeof(saved)], sizeof(saved));
+		set_callback(pe, InitCallback{ saved.kind, RVA{ saved.original_rva }, RVA{ saved.slot_rva } },
+		             RVA{ saved.original_rva });
+	}
+	return header.callback_count;
+}
+
+}
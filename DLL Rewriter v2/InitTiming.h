@@ -0,0 +1,43 @@
+/*
+Load-time instrumentation (--init-timing): the entry point and static TLS callbacks are
+redirected to `init_thunk`s from init_timing.asm, which measure them with rdtsc and
+store the results in the "inittime" section (see InitTimingFormat.h).
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "InitTimingFormat.h"
+#include "PElib.h"
+#include "PEView.h"
+
+namespace PElib
+{
+
+struct InitCallback
+{
+	InitCallbackKind kind;
+	RVA original;
+	RVA slot; // TLS: array entry holding the callback's VA
+};
+
+// Entry point (if there is one) followed by TLS callbacks from the callback array.
+std::vector<InitCallback> FindInitCallbacks(const PEEdit& pe);
+// Contents of the "inittime" section, without the records (they are zero-filled, so
+// the section's virtual size has to cover InitTimingSize()).
+std::string BuildInitTiming(const std::vector<InitCallback>& callbacks);
+uint InitTimingRecordsOffset(uint callback_count);
+uint InitTimingSize(uint callback_count);
+// Label of the `init_thunk` for callback `index` in generated code.
+std::string InitThunkLabel(uint index);
+// Points the entry point and TLS array entries to `thunks` (one per callback).
+void PatchInitCallbacks(PEEdit& pe, const std::vector<InitCallback>& callbacks,
+                        const std::vector<RVA>& thunks);
+// Undoes PatchInitCallbacks() of a previous run, using its "inittime" section.
+// Returns the number of restored callbacks.
+uint RestoreInitCallbacks(PEEdit& pe, uint section);
+
+}
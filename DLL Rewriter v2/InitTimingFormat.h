@@ -0,0 +1,67 @@
+/*
+Layout of the "inittime" section written by --init-timing (see init_timing.asm). Doesn't
+depend on Windows headers, so tools reading memory dumps can use it on any platform. All
+integers are little-endian.
+
+The section starts with `InitTimingHeader`, followed by:
+	InitTimingCallback callbacks[callback_count]                at callbacks_offset
+	InitTimingRecord records[callback_count][reason_count]      at records_offset
+Callback 0 is the entry point (DllMain) if the image has one, the rest are TLS callbacks
+in array order. Records are indexed by the reason code passed to the callback
+(DLL_PROCESS_DETACH = 0 ... DLL_THREAD_DETACH = 3), other reasons aren't recorded.
+
+The loader calls entry points and TLS callbacks with the loader lock held, so records
+are updated without atomic operations. Cycles are rdtsc deltas around the original
+callback, including the thunk's own overhead (tens of cycles).
+*/
+
+#pragma once
+
+#include <cstdint>
+
+namespace PElib
+{
+
+const uint32_t init_timing_reasons = 4;
+
+#pragma pack(push, 1)
+struct InitTimingHeader
+{
+	char magic[8];            // "DLLRINIT"
+	uint32_t version;         // 1
+	uint32_t callback_count;
+	uint32_t reason_count;    // init_timing_reasons
+	uint32_t record_size;     // sizeof(InitTimingRecord)
+	uint32_t callbacks_offset; // From the start of the header
+	uint32_t records_offset;  // From the start of the header, 64-byte aligned
+	uint32_t reserved[8];
+};
+
+enum class InitCallbackKind : uint32_t
+{
+	EntryPoint = 0,
+	Tls = 1,
+};
+
+struct InitTimingCallback
+{
+	InitCallbackKind kind;
+	uint32_t original_rva;    // The callback itself
+	uint32_t slot_rva;        // TLS: RVA of the patched array entry, entry point: 0
+	uint32_t reserved;
+};
+
+struct InitTimingRecord
+{
+	uint64_t calls;
+	uint64_t total_cycles;
+	uint64_t max_cycles;
+	uint64_t last_cycles;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(InitTimingHeader) == 64, "InitTimingHeader has to be 64 bytes");
+static_assert(sizeof(InitTimingCallback) == 16, "InitTimingCallback has to be 16 bytes");
+static_assert(sizeof(InitTimingRecord) == 32, "InitTimingRecord has to match init_timing.asm");
+
+}
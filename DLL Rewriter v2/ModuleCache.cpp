@@ -0,0 +1,151 @@
+#include "ModuleCache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+
+using std::ifstream;
+using std::set;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+using std::wstring;
+
+namespace PElib
+{
+
+// Splits "MODULE.Function" at the first dot, the same way the loader does.
+static bool split_forwarder(const string& forwarder, string* module, string* symbol)
+{
+	auto dot = forwarder.find('.');
+	if (dot == string::npos || dot == 0 || dot + 1 == forwarder.size())
+		return false;
+	*module = forwarder.substr(0, dot);
+	*symbol = forwarder.substr(dot + 1);
+	return true;
+}
+
+const char* ResolveStatusName(ResolveStatus status)
+{
+	switch (status)
+	{
+	case ResolveStatus::Ok: return "ok";
+	case ResolveStatus::ModuleNotFound: return "module not found";
+	case ResolveStatus::ExportNotFound: return "export not found";
+	case ResolveStatus::BadForwarder: return "malformed forwarder";
+	case ResolveStatus::ForwarderCycle: return "forwarder cycle";
+	}
+	return "unknown";
+}
+
+CachedModule::CachedModule(const PEView& pe)
+	: image_base(pe.OptionalHeader().ImageBase),
+	  timestamp(pe.FileHeader().TimeDateStamp),
+	  exports(pe)
+{}
+
+ModuleCache::ModuleCache(const vector<wstring>& search_path)
+	: search_path(search_path)
+{}
+
+string ModuleCache::ModuleKey(const string& name)
+{
+	string key = name;
+	std::transform(key.begin(), key.end(), key.begin(), [](char c) { return (char)tolower(c); });
+	if (key.size() > 4 && key.compare(key.size() - 4, 4, ".dll") == 0)
+		key.resize(key.size() - 4);
+	return key;
+}
+
+void ModuleCache::Add(const string& name, const PEView& pe)
+{
+	modules[ModuleKey(name)].reset(new CachedModule(pe));
+}
+
+const CachedModule* ModuleCache::Module(const string& module_name)
+{
+	auto key = ModuleKey(module_name);
+	auto it = modules.find(key);
+	if (it != modules.end())
+		return it->second.get();
+
+	auto& entry = modules[key];
+	for (const auto& dir : search_path)
+	{
+		wstring path = dir + path_separator + wstring(key.begin(), key.end()) + L".dll";
+		if (!ifstream(native_path(path)).good())
+			continue;
+		entry.reset(new CachedModule(*PEView::Load(path)));
+		break;
+	}
+	return entry.get();
+}
+
+const ExportIndex* ModuleCache::Exports(const string& module_name)
+{
+	const CachedModule* module = Module(module_name);
+	return module ? &module->exports : nullptr;
+}
+
+ResolvedExport ModuleCache::Resolve(const string& module_name, const Export& exp)
+{
+	if (!exp.IsForwarded())
+		return ResolvedExport{ ResolveStatus::Ok, module_name,
+		                       exp.name.empty() ? format("#%d", exp.ordinal) : exp.name,
+		                       exp.rva, 0 };
+	return ResolveForwarder(exp.forwarder);
+}
+
+ResolvedExport ModuleCache::ResolveForwarder(const string& forwarder)
+{
+	string module, symbol;
+	if (!split_forwarder(forwarder, &module, &symbol))
+		return ResolvedExport{ ResolveStatus::BadForwarder, "", forwarder, RVA{ 0 }, 0 };
+	auto res = ResolveSymbol(module, symbol);
+	res.hops++;
+	return res;
+}
+
+ResolvedExport ModuleCache::ResolveSymbol(const string& module_name, const string& symbol)
+{
+	ResolvedExport res = { ResolveStatus::Ok, module_name, symbol, RVA{ 0 }, 0 };
+	set<string> visited;
+	for (;;)
+	{
+		if (!visited.insert(ModuleKey(res.module) + "!" + res.symbol).second)
+		{
+			res.status = ResolveStatus::ForwarderCycle;
+			return res;
+		}
+		const ExportIndex* exports = Exports(res.module);
+		if (!exports)
+		{
+			res.status = ResolveStatus::ModuleNotFound;
+			return res;
+		}
+		const Export* exp = res.symbol[0] == '#'
+			? exports->FindByOrdinal(strtoul(res.symbol.c_str() + 1, nullptr, 10))
+			: exports->FindByName(res.symbol);
+		if (!exp || !exp->rva.val)
+		{
+			res.status = ResolveStatus::ExportNotFound;
+			return res;
+		}
+		if (!exp->IsForwarded())
+		{
+			res.rva = exp->rva;
+			return res;
+		}
+		if (!split_forwarder(exp->forwarder, &res.module, &res.symbol))
+		{
+			res.status = ResolveStatus::BadForwarder;
+			res.symbol = exp->forwarder;
+			return res;
+		}
+		res.hops++;
+	}
+}
+
+}
@@ -0,0 +1,77 @@
+/*
+`ModuleCache` lazily loads DLLs from a search path and keeps their export indexes, so that
+export forwarders ("MODULE.Function") can be followed to their final targets.
+*/
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "Exports.h"
+#include "PElib.h"
+#include "PEView.h"
+
+namespace PElib
+{
+
+enum class ResolveStatus
+{
+	Ok,
+	ModuleNotFound,
+	ExportNotFound,
+	BadForwarder,
+	ForwarderCycle,
+};
+
+struct ResolvedExport
+{
+	ResolveStatus status;
+	std::string module;  // Module containing the final target (or the one which failed)
+	std::string symbol;  // Function name or "#ordinal"
+	RVA rva;             // Valid only if status == Ok
+	uint hops;           // Number of forwarders followed
+};
+
+const char* ResolveStatusName(ResolveStatus status);
+
+struct CachedModule
+{
+	uint image_base;
+	uint timestamp; // TimeDateStamp from the file header, used by bound imports
+	ExportIndex exports;
+
+	explicit CachedModule(const PEView& pe);
+};
+
+class ModuleCache
+{
+	std::vector<std::wstring> search_path;
+	// Keys are lower-case module names without extension. nullptr marks modules which
+	// were already searched for and not found.
+	std::map<std::string, std::unique_ptr<CachedModule>> modules;
+
+	static std::string ModuleKey(const std::string& name);
+
+public:
+	ModuleCache(const std::vector<std::wstring>& search_path);
+
+	// Registers an already loaded module, e.g. the one being rewritten, so forwarders
+	// pointing back to it don't cause it to be parsed again.
+	void Add(const std::string& name, const PEView& pe);
+	// Returns nullptr if the module can't be found in the search path.
+	const CachedModule* Module(const std::string& module_name);
+	const ExportIndex* Exports(const std::string& module_name);
+
+	// Follows forwarder chain starting at `exp` from module `module_name`.
+	ResolvedExport Resolve(const std::string& module_name, const Export& exp);
+	// Follows forwarder chain starting at forwarder string, e.g. "NTDLL.RtlAllocateHeap".
+	ResolvedExport ResolveForwarder(const std::string& forwarder);
+	// Resolves export given by name or "#ordinal", following forwarders.
+	ResolvedExport ResolveSymbol(const std::string& module_name, const std::string& symbol);
+};
+
+}
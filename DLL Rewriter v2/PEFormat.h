@@ -0,0 +1,230 @@
+/*
+On-disk structures of 32-bit PE files, without Windows headers, so the whole library
+builds on any platform. Field names match <Windows.h>. The structures are packed, so they
+can be used in place, at any offset of file data; all integers are little-endian and are
+read directly, so only little-endian targets are supported.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error PE structures are read in place, which requires a little-endian target
+#endif
+
+namespace PElib
+{
+
+const uint16_t pe_dos_signature = 0x5A4D;      // "MZ"
+const uint32_t pe_nt_signature = 0x00004550;   // "PE\0\0"
+const uint16_t pe_optional32_magic = 0x10B;
+const uint16_t pe_optional64_magic = 0x20B;
+const uint32_t pe_directory_entries = 16;
+const uint32_t pe_section_name_size = 8;
+
+// FileHeader.Characteristics
+const uint16_t pe_file_relocs_stripped = 0x0001;
+const uint16_t pe_file_dll = 0x2000;
+
+// Indexes of OptionalHeader.DataDirectory
+const uint32_t pe_directory_export = 0;
+const uint32_t pe_directory_import = 1;
+const uint32_t pe_directory_basereloc = 5;
+const uint32_t pe_directory_tls = 9;
+const uint32_t pe_directory_bound_import = 11;
+const uint32_t pe_directory_delay_import = 13;
+
+// PeSectionHeader.Characteristics
+const uint32_t pe_scn_cnt_code = 0x00000020;
+const uint32_t pe_scn_cnt_initialized_data = 0x00000040;
+const uint32_t pe_scn_mem_discardable = 0x02000000;
+const uint32_t pe_scn_mem_execute = 0x20000000;
+const uint32_t pe_scn_mem_read = 0x40000000;
+const uint32_t pe_scn_mem_write = 0x80000000;
+
+// Types of base relocations (top 4 bits of each entry)
+const uint16_t pe_rel_based_absolute = 0;
+const uint16_t pe_rel_based_highlow = 3;
+
+// Import thunks with this bit set import by ordinal (in the low 16 bits)
+const uint32_t pe_ordinal_flag32 = 0x80000000;
+
+#pragma pack(push, 1)
+struct PeDosHeader
+{
+	uint16_t e_magic, e_cblp, e_cp, e_crlc, e_cparhdr, e_minalloc, e_maxalloc, e_ss;
+	uint16_t e_sp, e_csum, e_ip, e_cs, e_lfarlc, e_ovno, e_res[4], e_oemid, e_oeminfo;
+	uint16_t e_res2[10];
+	int32_t e_lfanew;               // File offset of PeNtHeaders32
+};
+
+struct PeFileHeader
+{
+	uint16_t Machine;
+	uint16_t NumberOfSections;
+	uint32_t TimeDateStamp;
+	uint32_t PointerToSymbolTable;
+	uint32_t NumberOfSymbols;
+	uint16_t SizeOfOptionalHeader;  // Section table follows the optional header
+	uint16_t Characteristics;
+};
+
+struct PeDataDirectory
+{
+	uint32_t VirtualAddress;
+	uint32_t Size;
+};
+
+struct PeOptionalHeader32
+{
+	uint16_t Magic;
+	uint8_t MajorLinkerVersion;
+	uint8_t MinorLinkerVersion;
+	uint32_t SizeOfCode;
+	uint32_t SizeOfInitializedData;
+	uint32_t SizeOfUninitializedData;
+	uint32_t AddressOfEntryPoint;
+	uint32_t BaseOfCode;
+	uint32_t BaseOfData;
+	uint32_t ImageBase;
+	uint32_t SectionAlignment;
+	uint32_t FileAlignment;
+	uint16_t MajorOperatingSystemVersion;
+	uint16_t MinorOperatingSystemVersion;
+	uint16_t MajorImageVersion;
+	uint16_t MinorImageVersion;
+	uint16_t MajorSubsystemVersion;
+	uint16_t MinorSubsystemVersion;
+	uint32_t Win32VersionValue;
+	uint32_t SizeOfImage;
+	uint32_t SizeOfHeaders;
+	uint32_t CheckSum;
+	uint16_t Subsystem;
+	uint16_t DllCharacteristics;
+	uint32_t SizeOfStackReserve;
+	uint32_t SizeOfStackCommit;
+	uint32_t SizeOfHeapReserve;
+	uint32_t SizeOfHeapCommit;
+	uint32_t LoaderFlags;
+	uint32_t NumberOfRvaAndSizes;   // Only this many entries are present in the file
+	PeDataDirectory DataDirectory[pe_directory_entries];
+};
+
+struct PeNtHeaders32
+{
+	uint32_t Signature;
+	PeFileHeader FileHeader;
+	PeOptionalHeader32 OptionalHeader;
+};
+
+struct PeSectionHeader
+{
+	uint8_t Name[pe_section_name_size]; // Not NUL-terminated if all 8 bytes are used
+	uint32_t VirtualSize;           // Misc.VirtualSize in <Windows.h>
+	uint32_t VirtualAddress;
+	uint32_t SizeOfRawData;
+	uint32_t PointerToRawData;
+	uint32_t PointerToRelocations;
+	uint32_t PointerToLinenumbers;
+	uint16_t NumberOfRelocations;
+	uint16_t NumberOfLinenumbers;
+	uint32_t Characteristics;
+};
+
+struct PeExportDirectory
+{
+	uint32_t Characteristics;
+	uint32_t TimeDateStamp;
+	uint16_t MajorVersion;
+	uint16_t MinorVersion;
+	uint32_t Name;
+	uint32_t Base;
+	uint32_t NumberOfFunctions;
+	uint32_t NumberOfNames;
+	uint32_t AddressOfFunctions;
+	uint32_t AddressOfNames;
+	uint32_t AddressOfNameOrdinals;
+};
+
+struct PeImportDescriptor
+{
+	uint32_t OriginalFirstThunk;    // Characteristics in old headers
+	uint32_t TimeDateStamp;
+	uint32_t ForwarderChain;
+	uint32_t Name;
+	uint32_t FirstThunk;
+};
+
+struct PeImportByName
+{
+	uint16_t Hint;
+	char Name[1];                   // NUL-terminated
+};
+
+struct PeBoundImportDescriptor
+{
+	uint32_t TimeDateStamp;
+	uint16_t OffsetModuleName;      // From the start of the bound import directory
+	uint16_t NumberOfModuleForwarderRefs; // PeBoundForwarderRefs following this descriptor
+};
+
+struct PeBoundForwarderRef
+{
+	uint32_t TimeDateStamp;
+	uint16_t OffsetModuleName;
+	uint16_t Reserved;
+};
+
+struct PeTlsDirectory32
+{
+	uint32_t StartAddressOfRawData; // All addresses are VAs
+	uint32_t EndAddressOfRawData;
+	uint32_t AddressOfIndex;
+	uint32_t AddressOfCallBacks;    // Null-terminated array of VAs
+	uint32_t SizeOfZeroFill;
+	uint32_t Characteristics;
+};
+
+struct PeBaseRelocation
+{
+	uint32_t VirtualAddress;
+	uint32_t SizeOfBlock;           // Including this header, followed by 16-bit entries
+};
+#pragma pack(pop)
+
+// Sizes and offsets from the PE/COFF specification.
+static_assert(sizeof(PeDosHeader) == 64, "PeDosHeader has to be 64 bytes");
+static_assert(offsetof(PeDosHeader, e_lfanew) == 60, "Bad offset of e_lfanew");
+static_assert(sizeof(PeFileHeader) == 20, "PeFileHeader has to be 20 bytes");
+static_assert(offsetof(PeFileHeader, SizeOfOptionalHeader) == 16,
+              "Bad offset of SizeOfOptionalHeader");
+static_assert(sizeof(PeDataDirectory) == 8, "PeDataDirectory has to be 8 bytes");
+static_assert(sizeof(PeOptionalHeader32) == 224, "PeOptionalHeader32 has to be 224 bytes");
+static_assert(offsetof(PeOptionalHeader32, AddressOfEntryPoint) == 16,
+              "Bad offset of AddressOfEntryPoint");
+static_assert(offsetof(PeOptionalHeader32, ImageBase) == 28, "Bad offset of ImageBase");
+static_assert(offsetof(PeOptionalHeader32, SizeOfImage) == 56, "Bad offset of SizeOfImage");
+static_assert(offsetof(PeOptionalHeader32, CheckSum) == 64, "Bad offset of CheckSum");
+static_assert(offsetof(PeOptionalHeader32, NumberOfRvaAndSizes) == 92,
+              "Bad offset of NumberOfRvaAndSizes");
+static_assert(offsetof(PeOptionalHeader32, DataDirectory) == 96, "Bad offset of DataDirectory");
+static_assert(sizeof(PeNtHeaders32) == 248, "PeNtHeaders32 has to be 248 bytes");
+static_assert(offsetof(PeNtHeaders32, OptionalHeader) == 24, "Bad offset of OptionalHeader");
+static_assert(sizeof(PeSectionHeader) == 40, "PeSectionHeader has to be 40 bytes");
+static_assert(offsetof(PeSectionHeader, PointerToRawData) == 20,
+              "Bad offset of PointerToRawData");
+static_assert(offsetof(PeSectionHeader, Characteristics) == 36,
+              "Bad offset of Characteristics");
+static_assert(sizeof(PeExportDirectory) == 40, "PeExportDirectory has to be 40 bytes");
+static_assert(offsetof(PeExportDirectory, AddressOfFunctions) == 28,
+              "Bad offset of AddressOfFunctions");
+static_assert(sizeof(PeImportDescriptor) == 20, "PeImportDescriptor has to be 20 bytes");
+static_assert(sizeof(PeImportByName) == 3, "PeImportByName has to be 3 bytes");
+static_assert(sizeof(PeBoundImportDescriptor) == 8, "PeBoundImportDescriptor has to be 8 bytes");
+static_assert(sizeof(PeBoundForwarderRef) == 8, "PeBoundForwarderRef has to be 8 bytes");
+static_assert(sizeof(PeTlsDirectory32) == 24, "PeTlsDirectory32 has to be 24 bytes");
+static_assert(sizeof(PeBaseRelocation) == 8, "PeBaseRelocation has to be 8 bytes");
+
+}
@@ -0,0 +1,98 @@
+#include "PEImage.h"
+
+#include <cstring>
+
+namespace PElib
+{
+
+PEImage::PEImage(ByteView data)
+	: file(data)
+{
+	// MZ header
+	if (!file.Contains(0, sizeof(PeDosHeader)))
+		fatal_error("File is too small to be a PE file");
+	dos = &file.At<PeDosHeader>(0);
+	if (dos->e_magic != pe_dos_signature)
+		fatal_error("Invalid MZ signature");
+	size_t header_size = sizeof(nt->Signature) + sizeof(nt->FileHeader);
+	if (dos->e_lfanew < (int32_t)sizeof(PeDosHeader) || !file.Contains(dos->e_lfanew, header_size))
+		fatal_error("Bad value of field MZ.e_lfanew: %08x", dos->e_lfanew);
+
+	// PE header. The optional header may be shorter than PeOptionalHeader32, so only
+	// its declared size is checked here.
+	size_t pos = dos->e_lfanew;
+	nt = (const PeNtHeaders32*)(file.Data() + pos);
+	if (nt->Signature != pe_nt_signature)
+		fatal_error("Invalid PE signature");
+	pos += header_size;
+	size_t optional_size = nt->FileHeader.SizeOfOptionalHeader;
+	if (!file.Contains(pos, optional_size))
+		fatal_error("Truncated optional header");
+	const auto& optional = nt->OptionalHeader;
+	size_t directories_offset = offsetof(PeOptionalHeader32, DataDirectory);
+	if (optional_size < directories_offset)
+		fatal_error("Truncated optional header");
+	// PE32+ has a different layout, e.g. its directories are 16 bytes further.
+	if (optional.Magic != pe_optional32_magic)
+		fatal_error("Unsupported optional header (Magic=%04x), only PE32 images are supported",
+		            optional.Magic);
+	if (optional.NumberOfRvaAndSizes > pe_directory_entries
+		|| optional.NumberOfRvaAndSizes > (optional_size - directories_offset) / sizeof(PeDataDirectory))
+		fatal_error("Bad value of field PE.OptionalHeader.NumberOfRvaAndSizes: %d",
+		            optional.NumberOfRvaAndSizes);
+	directories = file.Array<PeDataDirectory>(pos + directories_offset, optional.NumberOfRvaAndSizes);
+	if (!optional.FileAlignment || !optional.SectionAlignment)
+		fatal_error("Invalid section or file alignment");
+	pos += optional_size;
+
+	// Section headers
+	auto sections_count = nt->FileHeader.NumberOfSections;
+	if ((file.Size() - pos) / sizeof(PeSectionHeader) < sections_count)
+		fatal_error("Truncated section table");
+	sections = file.Array<PeSectionHeader>(pos, sections_count);
+	for (const auto& hdr : sections)
+		if (!file.Contains(hdr.PointerToRawData, hdr.SizeOfRawData))
+			fatal_error("Section data outside of file");
+}
+
+ByteView PEImage::SectionData(size_t index) const
+{
+	const auto& hdr = sections.at(index);
+	return file.Sub(hdr.PointerToRawData, hdr.SizeOfRawData);
+}
+
+const PeSectionHeader* PEImage::SectionFromRVA(uint32_t rva) const
+{
+	for (const auto& hdr : sections)
+		if (hdr.VirtualAddress <= rva && rva - hdr.VirtualAddress < hdr.VirtualSize)
+			return &hdr;
+	return nullptr;
+}
+
+ByteView PEImage::AtRVA(uint32_t rva, uint32_t size) const
+{
+	auto hdr = SectionFromRVA(rva);
+	if (!hdr)
+		fatal_error("RVA outside of sections! (RVA=%08x)", rva);
+	uint32_t offset = rva - hdr->VirtualAddress;
+	if (offset > hdr->SizeOfRawData || size > hdr->SizeOfRawData - offset)
+		fatal_error("Data outside of section raw data! (RVA=%08x, size=%x)", rva, size);
+	return file.Sub(hdr->PointerToRawData + offset, size);
+}
+
+const char* PEImage::StringAtRVA(uint32_t rva, size_t* length) const
+{
+	auto hdr = SectionFromRVA(rva);
+	uint32_t offset = hdr ? rva - hdr->VirtualAddress : 0;
+	if (!hdr || offset >= hdr->SizeOfRawData)
+		fatal_error("String outside of section data! (RVA=%08x)", rva);
+	const char* begin = file.Data() + hdr->PointerToRawData + offset;
+	const char* end = (const char*)memchr(begin, '\0', hdr->SizeOfRawData - offset);
+	if (!end)
+		fatal_error("Unterminated string at RVA=%08x", rva);
+	if (length)
+		*length = end - begin;
+	return begin;
+}
+
+}
@@ -0,0 +1,120 @@
+/*
+Zero-copy parsing of 32-bit PE files, using structures from PEFormat.h. Doesn't depend on
+Windows headers. `PEImage` validates the headers once and hands out typed views pointing
+into the file data; everything is bounds-checked and fails with `fatal_error`. The data
+has to outlive the views.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "common.h"
+#include "PEFormat.h"
+
+namespace PElib
+{
+
+// `count` objects of type `T` in file data. Indexing is bounds-checked.
+template<typename T>
+class ArrayView
+{
+	const T* items;
+	size_t count;
+
+public:
+	ArrayView() : items(nullptr), count(0) {}
+	ArrayView(const T* items, size_t count) : items(items), count(count) {}
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	const T* begin() const { return items; }
+	const T* end() const { return items + count; }
+	const T& operator[](size_t index) const { return at(index); }
+	const T& at(size_t index) const
+	{
+		if (index >= count)
+			fatal_error("Index out of range (%zd >= %zd)", index, count);
+		return items[index];
+	}
+	const T& back() const { return at(count - 1); }
+};
+
+// Range of file data.
+class ByteView
+{
+	const char* bytes;
+	size_t length;
+
+public:
+	ByteView() : bytes(nullptr), length(0) {}
+	ByteView(const void* bytes, size_t length) : bytes((const char*)bytes), length(length) {}
+
+	const char* Data() const { return bytes; }
+	size_t Size() const { return length; }
+	bool Contains(size_t offset, size_t size) const
+	{
+		return offset <= length && size <= length - offset;
+	}
+
+	ByteView Sub(size_t offset, size_t size) const
+	{
+		if (!Contains(offset, size))
+			fatal_error("Data out of range (%zx bytes at %zx, %zx available)", size, offset, length);
+		return ByteView(bytes + offset, size);
+	}
+
+	// Structures from PEFormat.h may be at any offset. Other types (e.g. arrays of
+	// uint32_t) have to be aligned, as the PE format requires for them anyway.
+	template<typename T> ArrayView<T> Array(size_t offset, size_t count) const
+	{
+		if (count > length / sizeof(T))
+			fatal_error("Data out of range (%zd items at %zx)", count, offset);
+		auto range = Sub(offset, count * sizeof(T));
+		if ((uintptr_t)range.bytes % alignof(T) != 0)
+			fatal_error("Misaligned data at %zx", offset);
+		return ArrayView<T>((const T*)range.bytes, count);
+	}
+
+	template<typename T> const T& At(size_t offset) const
+	{
+		return *Array<T>(offset, 1).begin();
+	}
+};
+
+class PEImage
+{
+	ByteView file;
+	const PeDosHeader* dos;
+	const PeNtHeaders32* nt;
+	ArrayView<PeDataDirectory> directories;
+	ArrayView<PeSectionHeader> sections;
+
+public:
+	// Validates the headers and section table. `data` isn't copied.
+	explicit PEImage(ByteView data);
+
+	ByteView File() const { return file; }
+	const PeDosHeader& Dos() const { return *dos; }
+	// Only the first SizeOfOptionalHeader bytes of the optional header are validated,
+	// which covers all of `Directories()`.
+	const PeNtHeaders32& Nt() const { return *nt; }
+	const PeFileHeader& FileHeader() const { return nt->FileHeader; }
+	const PeOptionalHeader32& OptionalHeader() const { return nt->OptionalHeader; }
+	// First NumberOfRvaAndSizes entries of DataDirectory.
+	ArrayView<PeDataDirectory> Directories() const { return directories; }
+	ArrayView<PeSectionHeader> Sections() const { return sections; }
+
+	// Raw data of section `index` (SizeOfRawData bytes).
+	ByteView SectionData(size_t index) const;
+	// Returns nullptr if `rva` isn't inside of any section.
+	const PeSectionHeader* SectionFromRVA(uint32_t rva) const;
+	// `size` bytes at `rva`. Fails if they aren't all backed by raw data of a single
+	// section.
+	ByteView AtRVA(uint32_t rva, uint32_t size) const;
+	// NUL-terminated string at `rva`, which has to end in the same section.
+	const char* StringAtRVA(uint32_t rva, size_t* length = nullptr) const;
+};
+
+}
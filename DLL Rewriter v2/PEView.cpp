@@ -0,0 +1,575 @@
+#include "PEView.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+
+#include "common.h"
+
+using std::ios;
+using std::map;
+using std::min;
+using std::numeric_limits;
+using std::ofstream;
+using std::ostream;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+using std::wstring;
+
+namespace PElib
+{
+
+//--------------------------------------------------------
+// PEView
+//--------------------------------------------------------
+
+PEView::PEView(string file_data)
+	: data(std::move(file_data)),
+	  image(ByteView(data.data(), data.size()))
+{
+	// PeHeader() exposes the whole structure, even if the optional header is shorter.
+	if (!image.File().Contains(image.Dos().e_lfanew, sizeof(PeNtHeaders32)))
+		fatal_error("Truncated PE header");
+}
+
+shared_ptr<const PEView> PEView::Load(const wstring& file_path)
+{
+	return std::make_shared<const PEView>(read_whole_file(file_path));
+}
+
+const string& PEView::Data() const
+{
+	return data;
+}
+
+const PEImage& PEView::Image() const
+{
+	return image;
+}
+
+const char* PEView::DosStub() const
+{
+	return data.data() + sizeof(PeDosHeader);
+}
+
+uint PEView::DosStubSize() const
+{
+	return image.Dos().e_lfanew - sizeof(PeDosHeader);
+}
+
+const PeDosHeader& PEView::MzHeader() const
+{
+	return image.Dos();
+}
+
+const PeNtHeaders32& PEView::PeHeader() const
+{
+	return image.Nt();
+}
+
+const PeFileHeader& PEView::FileHeader() const
+{
+	return PeHeader().FileHeader;
+}
+
+const PeOptionalHeader32& PEView::OptionalHeader() const
+{
+	return PeHeader().OptionalHeader;
+}
+
+ArrayView<PeSectionHeader> PEView::Sections() const
+{
+	return image.Sections();
+}
+
+const char* PEView::SectionData(uint index) const
+{
+	return image.SectionData(index).Data();
+}
+
+const PeSectionHeader& PEView::SectionFromRVA(RVA rva) const
+{
+	auto header = image.SectionFromRVA(rva.val);
+	if (!header)
+		fatal_error("Bad argument passed to %s! (RVA=%08x)", __FUNCTION__, rva.val);
+	return *header;
+}
+
+const PeDataDirectory& PEView::Directory(uint index) const
+{
+	if (index >= image.Directories().size())
+		fatal_error("Bad argument passed to %s! (index=%08x)", __FUNCTION__, index);
+	return image.Directories()[index];
+}
+
+RVA PEView::NextFreeRVA() const
+{
+	const auto& last = Sections().back();
+	return RVA{ last.VirtualAddress + align_up(last.VirtualSize, OptionalHeader().SectionAlignment) };
+}
+
+bool PEView::IsAddrReadable(RVA rva) const
+{
+	return (SectionFromRVA(rva).Characteristics & pe_scn_mem_read) != 0;
+}
+
+bool PEView::IsAddrWritable(RVA rva) const
+{
+	return (SectionFromRVA(rva).Characteristics & pe_scn_mem_write) != 0;
+}
+
+bool PEView::IsAddrExecutable(RVA rva) const
+{
+	return (SectionFromRVA(rva).Characteristics & pe_scn_mem_execute) != 0;
+}
+
+const char* PEView::Pointer(RVA rva, uint size) const
+{
+	return image.AtRVA(rva.val, size).Data();
+}
+
+string PEView::ReadString(RVA rva) const
+{
+	size_t length;
+	const char* str = image.StringAtRVA(rva.val, &length);
+	return string(str, length);
+}
+
+//--------------------------------------------------------
+// PEEdit
+//--------------------------------------------------------
+
+// Same algorithm as PE::Checksum, but fed with consecutive pieces of the file.
+class ChecksumBuilder
+{
+	uint sum = 0;
+	ull size = 0;
+	bool has_odd_byte = false;
+	uchar odd_byte = 0;
+
+	void AddWord(uint word)
+	{
+		sum += word;
+		sum = (ushort)sum + (sum >> 16);
+	}
+
+public:
+	void Add(const char* data, size_t len)
+	{
+		size_t i = 0;
+		if (has_odd_byte && len)
+		{
+			AddWord(odd_byte | (uchar)data[0] << 8);
+			has_odd_byte = false;
+			i = 1;
+		}
+		for (; i + 1 < len; i += 2)
+			AddWord((uchar)data[i] | (uchar)data[i + 1] << 8);
+		if (i < len)
+		{
+			odd_byte = data[i];
+			has_odd_byte = true;
+		}
+		size += len;
+	}
+
+	uint Finish()
+	{
+		if (has_odd_byte)
+			AddWord(odd_byte);
+		return sum + (uint)size;
+	}
+};
+
+PEEdit::PEEdit(shared_ptr<const PEView> view)
+	: view(view),
+	  MZ_header(view->MzHeader()),
+	  PE_header(view->PeHeader())
+{
+	// Directories past NumberOfRvaAndSizes are garbage (or the section table) in the view.
+	auto& optional = PE_header.OptionalHeader;
+	for (uint i = optional.NumberOfRvaAndSizes; i < pe_directory_entries; i++)
+		optional.DataDirectory[i] = PeDataDirectory{ 0, 0 };
+	for (uint i = 0; i < view->Sections().size(); i++)
+		sections.push_back(Section{ view->Sections()[i], view->SectionData(i), nullptr });
+}
+
+const PEView& PEEdit::View() const
+{
+	return *view;
+}
+
+const PeNtHeaders32& PEEdit::PeHeader() const
+{
+	return PE_header;
+}
+
+PeNtHeaders32& PEEdit::PeHeader()
+{
+	return PE_header;
+}
+
+uint PEEdit::SectionCount() const
+{
+	return sections.size();
+}
+
+const PeSectionHeader& PEEdit::SectionHeader(uint index) const
+{
+	return sections.at(index).header;
+}
+
+int PEEdit::FindSection(const string& name) const
+{
+	for (size_t i = 0; i < sections.size(); i++)
+		if (strncmp((const char*)sections[i].header.Name, name.c_str(),
+		            sizeof(sections[i].header.Name)) == 0)
+		{
+			return (int)i;
+		}
+	return -1;
+}
+
+void PEEdit::AddSection(const string& name, RVA rva, uint vsize, const string& data,
+                        uint characteristics)
+{
+	Section section;
+	memset(&section.header, 0, sizeof(section.header));
+	memcpy(section.header.Name, name.c_str(), min(sizeof(section.header.Name), name.size()));
+	section.header.Characteristics = characteristics;
+	section.header.VirtualAddress = rva.val;
+	section.header.VirtualSize = vsize;
+	section.header.SizeOfRawData = data.size();
+	section.owned = std::make_shared<const string>(data);
+	section.data = section.owned->data();
+	sections.push_back(section);
+	PE_header.FileHeader.NumberOfSections++;
+}
+
+void PEEdit::RemoveSection(int index)
+{
+	const auto& header = sections.at(index).header;
+	patches.erase(patches.lower_bound(header.VirtualAddress),
+	              patches.lower_bound(header.VirtualAddress + header.SizeOfRawData));
+	sections.erase(sections.begin() + index);
+	PE_header.FileHeader.NumberOfSections--;
+}
+
+void PEEdit::MergeWithNext(uint index)
+{
+	if (index + 1 >= sections.size())
+		fatal_error("Bad argument passed to %s! (index=%d)", __FUNCTION__, index);
+	auto& first = sections[index];
+	const auto& second = sections[index + 1];
+	uint first_vsize = first.header.VirtualSize ? first.header.VirtualSize
+	                                                 : first.header.SizeOfRawData;
+	uint second_vsize = second.header.VirtualSize ? second.header.VirtualSize
+	                                                   : second.header.SizeOfRawData;
+	uint gap_begin = first.header.VirtualAddress;
+	uint second_offset = second.header.VirtualAddress - gap_begin;
+	if (second.header.VirtualAddress
+		!= gap_begin + align_up(first_vsize, PE_header.OptionalHeader.SectionAlignment))
+		fatal_error("Sections %d and %d are not adjacent", index, index + 1);
+
+	// Raw data of the first section may be padded past the second one's start.
+	uint first_size = min(first.header.SizeOfRawData, second_offset);
+	patches.erase(patches.lower_bound(gap_begin + first_size),
+	              patches.lower_bound(gap_begin + first.header.SizeOfRawData));
+	auto data = std::make_shared<string>(first.data, first_size);
+	data->resize(second_offset, '\0');
+	data->append(second.data, second.header.SizeOfRawData);
+
+	first.header.VirtualSize = second_offset + second_vsize;
+	first.header.SizeOfRawData = data->size();
+	first.owned = data;
+	first.data = data->data();
+	sections.erase(sections.begin() + index + 1);
+	PE_header.FileHeader.NumberOfSections--;
+}
+
+uint PEEdit::TrimSection(uint index)
+{
+	auto& section = sections.at(index);
+	auto& header = section.header;
+	uint begin = header.VirtualAddress;
+	uint used = header.SizeOfRawData;
+	while (used && !section.data[used - 1])
+		used--;
+	for (auto it = patches.lower_bound(begin);
+	     it != patches.end() && it->first < begin + header.SizeOfRawData; ++it)
+	{
+		auto last = it->second.find_last_not_of('\0');
+		if (last != string::npos)
+			used = std::max(used, it->first - begin + (uint)last + 1);
+	}
+	uint new_size = align_up(used, PE_header.OptionalHeader.FileAlignment);
+	if (new_size >= header.SizeOfRawData)
+		return 0;
+
+	// Trimmed bytes become virtual-only, the loader zero-fills them.
+	uint trimmed = header.SizeOfRawData - new_size;
+	if (!header.VirtualSize)
+		header.VirtualSize = header.SizeOfRawData;
+	header.SizeOfRawData = new_size;
+	// Patches past the new end contain only zeros.
+	uint end = begin + new_size;
+	patches.erase(patches.lower_bound(end), patches.lower_bound(end + trimmed));
+	auto last = patches.lower_bound(end);
+	if (last != patches.begin() && (--last)->first >= begin
+		&& last->first + last->second.size() > end)
+	{
+		last->second.resize(end - last->first);
+	}
+	return trimmed;
+}
+
+RVA PEEdit::NextFreeRVA() const
+{
+	return RVA{ sections.back().header.VirtualAddress +
+		align_up(sections.back().header.VirtualSize,
+		         PE_header.OptionalHeader.SectionAlignment) };
+}
+
+void PEEdit::SetDirectory(uint index, RVA rva, uint size)
+{
+	if (index >= pe_directory_entries)
+		fatal_error("Bad argument passed to %s! (index=%08x)", __FUNCTION__, index);
+	if (index >= PE_header.OptionalHeader.NumberOfRvaAndSizes)
+		PE_header.OptionalHeader.NumberOfRvaAndSizes = index + 1;
+	PE_header.OptionalHeader.DataDirectory[index].VirtualAddress = rva.val;
+	PE_header.OptionalHeader.DataDirectory[index].Size = size;
+}
+
+const PEEdit::Section* PEEdit::RawSection(RVA rva, uint size) const
+{
+	for (const auto& section : sections)
+		if (section.header.VirtualAddress <= rva.val
+			&& rva.val - section.header.VirtualAddress < section.header.SizeOfRawData)
+		{
+			if (size > section.header.SizeOfRawData - (rva.val - section.header.VirtualAddress))
+				return nullptr;
+			return &section;
+		}
+	return nullptr;
+}
+
+string PEEdit::Read(RVA rva, uint size) const
+{
+	const Section* section = RawSection(rva, size);
+	if (!section)
+		fatal_error("Bad argument passed to %s! (RVA=%08x, size=%x)", __FUNCTION__, rva.val, size);
+	string res(section->data + (rva.val - section->header.VirtualAddress), size);
+
+	// Overlay patches intersecting the range.
+	uint end = rva.val + size;
+	auto it = patches.upper_bound(rva.val);
+	if (it != patches.begin())
+		--it;
+	for (; it != patches.end() && it->first < end; ++it)
+	{
+		uint patch_end = it->first + it->second.size();
+		if (patch_end <= rva.val)
+			continue;
+		uint begin = std::max(it->first, rva.val);
+		memcpy(&res[begin - rva.val], it->second.data() + (begin - it->first),
+		       min(patch_end, end) - begin);
+	}
+	return res;
+}
+
+void PEEdit::Patch(RVA rva, const void* data, uint size)
+{
+	const Section* section = size ? RawSection(rva, size) : nullptr;
+	if (!section)
+		fatal_error("Bad argument passed to %s! (RVA=%08x, size=%x)", __FUNCTION__, rva.val, size);
+	const PeSectionHeader* header = &section->header;
+	uint section_begin = header->VirtualAddress;
+	uint section_end = section_begin + header->SizeOfRawData;
+
+	// Merge with all overlapping or adjacent patches from the same section, so consecutive
+	// small patches (e.g. of an export table) end up as a single range.
+	uint begin = rva.val;
+	uint end = rva.val + size;
+	auto it = patches.upper_bound(begin);
+	if (it != patches.begin())
+	{
+		auto prev = std::prev(it);
+		if (prev->first >= section_begin && prev->first + prev->second.size() >= begin)
+			it = prev;
+	}
+	string merged;
+	uint merged_begin = begin;
+	while (it != patches.end() && it->first <= end && it->first < section_end)
+	{
+		if (merged.empty())
+		{
+			merged_begin = min(begin, it->first);
+			merged = it->second;
+		}
+		else
+		{
+			merged.resize(it->first - merged_begin);
+			merged += it->second;
+		}
+		it = patches.erase(it);
+	}
+	uint merged_end = std::max(end, merged_begin + (uint)merged.size());
+	merged.resize(merged_end - merged_begin);
+	memcpy(&merged[begin - merged_begin], data, size);
+	patches[merged_begin] = std::move(merged);
+}
+
+const map<uint, string>& PEEdit::Patches() const
+{
+	return patches;
+}
+
+string PEEdit::BuildHeaders()
+{
+	// Fix pointers
+	MZ_header.e_lfanew = sizeof(MZ_header) + view->DosStubSize();
+	if (sections.size() > numeric_limits<ushort>::max())
+		fatal_error("Too many sections! (%zd)", sections.size());
+	PE_header.FileHeader.NumberOfSections = (ushort)sections.size();
+	PE_header.FileHeader.SizeOfOptionalHeader = sizeof(PE_header.OptionalHeader);
+	PE_header.OptionalHeader.NumberOfRvaAndSizes = pe_directory_entries;
+	PE_header.OptionalHeader.CheckSum = 0;
+	PE_header.OptionalHeader.SizeOfImage =
+		align_up(sections.back().header.VirtualAddress + sections.back().header.VirtualSize,
+		         PE_header.OptionalHeader.SectionAlignment);
+	PE_header.OptionalHeader.SizeOfHeaders =
+		align_up(MZ_header.e_lfanew + sizeof(PE_header.Signature) + sizeof(PE_header.FileHeader)
+		         + PE_header.FileHeader.SizeOfOptionalHeader
+		         + sections.size() * sizeof(PeSectionHeader),
+		         PE_header.OptionalHeader.FileAlignment);
+	uint file_pos = PE_header.OptionalHeader.SizeOfHeaders;
+	for (auto& section : sections)
+	{
+		section.header.PointerToRawData = file_pos;
+		file_pos = align_up(file_pos + section.header.SizeOfRawData,
+		                    PE_header.OptionalHeader.FileAlignment);
+	}
+
+	string res;
+	res.append((const char*)&MZ_header, sizeof(MZ_header));
+	res.append(view->DosStub(), view->DosStubSize());
+	res.append((const char*)&PE_header, sizeof(PE_header));
+	for (const auto& section : sections)
+		res.append((const char*)&section.header, sizeof(section.header));
+	res.resize(PE_header.OptionalHeader.SizeOfHeaders, '\0');
+	return res;
+}
+
+// Calls `callback(const char* data, size_t size)` for consecutive pieces of the output file.
+template<typename F> void PEEdit::ForEachChunk(const string& headers, F callback) const
+{
+	static const char zeros[0x1000] = {};
+	size_t pos = 0;
+	auto emit = [&](const char* data, size_t size)
+	{
+		if (size)
+			callback(data, size);
+		pos += size;
+	};
+	auto pad_to = [&](size_t new_pos)
+	{
+		while (pos < new_pos)
+			emit(zeros, min(sizeof(zeros), new_pos - pos));
+	};
+
+	emit(headers.data(), headers.size());
+	for (const auto& section : sections)
+	{
+		pad_to(section.header.PointerToRawData);
+		uint begin = section.header.VirtualAddress;
+		uint end = begin + section.header.SizeOfRawData;
+		uint cur = begin;
+		for (auto it = patches.lower_bound(begin); it != patches.end() && it->first < end; ++it)
+		{
+			emit(section.data + (cur - begin), it->first - cur);
+			emit(it->second.data(), it->second.size());
+			cur = it->first + it->second.size();
+		}
+		emit(section.data + (cur - begin), end - cur);
+	}
+}
+
+void PEEdit::Write(ostream& out)
+{
+	string headers = BuildHeaders();
+
+	// PE checksum needs the whole file, so it's computed in a separate pass.
+	ChecksumBuilder checksum;
+	ForEachChunk(headers, [&](const char* data, size_t size) { checksum.Add(data, size); });
+	uint new_checksum = checksum.Finish();
+	auto checksum_pos = MZ_header.e_lfanew
+		+ offsetof(PeNtHeaders32, OptionalHeader)
+		+ offsetof(PeOptionalHeader32, CheckSum);
+	memcpy(&headers[checksum_pos], &new_checksum, sizeof(new_checksum));
+	PE_header.OptionalHeader.CheckSum = new_checksum;
+
+	ForEachChunk(headers, [&](const char* data, size_t size) { out.write(data, size); });
+}
+
+string PEEdit::Build()
+{
+	std::ostringstream out;
+	Write(out);
+	return out.str();
+}
+
+string PEEdit::BuildInPlace() const
+{
+	const auto& old_header = view->PeHeader();
+	bool same_layout = sections.size() == view->Sections().size()
+		&& PE_header.FileHeader.SizeOfOptionalHeader == old_header.FileHeader.SizeOfOptionalHeader
+		&& PE_header.OptionalHeader.NumberOfRvaAndSizes == old_header.OptionalHeader.NumberOfRvaAndSizes;
+	for (uint i = 0; same_layout && i < sections.size(); i++)
+		same_layout = sections[i].data == view->SectionData(i)
+			&& memcmp(&sections[i].header, &view->Sections()[i], sizeof(PeSectionHeader)) == 0;
+	if (!same_layout)
+		fatal_error("Sections were changed, the image can't be written in place");
+
+	// Only the part of the optional header present in the file is written, the section
+	// table may follow right after the last valid directory.
+	string res = view->Data();
+	uint nt_offset = view->MzHeader().e_lfanew;
+	uint headers_size = offsetof(PeNtHeaders32, OptionalHeader)
+		+ min((uint)PE_header.FileHeader.SizeOfOptionalHeader,
+		      (uint)(offsetof(PeOptionalHeader32, DataDirectory)
+		             + PE_header.OptionalHeader.NumberOfRvaAndSizes * sizeof(PeDataDirectory)));
+	memcpy(&res[nt_offset], &PE_header, min(headers_size, (uint)sizeof(PE_header)));
+	for (const auto& patch : patches)
+	{
+		auto offset = view->ConvertTo<FILE_OFFSET>(RVA{ patch.first });
+		memcpy(&res[offset.val], patch.second.data(), patch.second.size());
+	}
+
+	auto checksum_pos = nt_offset
+		+ offsetof(PeNtHeaders32, OptionalHeader)
+		+ offsetof(PeOptionalHeader32, CheckSum);
+	memset(&res[checksum_pos], 0, sizeof(uint));
+	ChecksumBuilder checksum;
+	checksum.Add(res.data(), res.size());
+	uint new_checksum = checksum.Finish();
+	memcpy(&res[checksum_pos], &new_checksum, sizeof(new_checksum));
+	return res;
+}
+
+void PEEdit::Save(const wstring& file_path)
+{
+	ofstream f(native_path(file_path), ios::binary);
+	if (f.fail())
+		fatal_error("Cannot open file: %ls", file_path.c_str());
+	Write(f);
+	f.close();
+	if (f.fail())
+		fatal_error("Cannot write file: %ls", file_path.c_str());
+}
+
+}
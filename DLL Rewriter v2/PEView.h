@@ -0,0 +1,168 @@
+/*
+`PEView` is an immutable, parsed PE file. It has only const methods, so one instance can be
+shared between threads. Headers aren't copied: accessors return structures from
+PEFormat.h laid over the file data, which is parsed by `PEImage` (see PEImage.h). `PEEdit`
+is a lightweight set of modifications (headers, added and removed sections, patched bytes)
+on top of a shared view. Saving streams unchanged data directly from the view, without
+copying it. Nothing here depends on Windows headers.
+*/
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "PEImage.h"
+#include "PElib.h"
+
+namespace PElib
+{
+
+class PEView
+{
+	std::string data;
+	PEImage image; // Points into `data`
+
+public:
+	explicit PEView(std::string file_data);
+	PEView(const PEView&) = delete;
+	PEView& operator=(const PEView&) = delete;
+	static std::shared_ptr<const PEView> Load(const std::wstring& file_path);
+
+	// Whole file, as loaded.
+	const std::string& Data() const;
+	const PEImage& Image() const;
+	const char* DosStub() const;
+	uint DosStubSize() const;
+	const PeDosHeader& MzHeader() const;
+	// Entries of DataDirectory past NumberOfRvaAndSizes aren't valid, use Directory().
+	const PeNtHeaders32& PeHeader() const;
+	const PeFileHeader& FileHeader() const;
+	const PeOptionalHeader32& OptionalHeader() const;
+	ArrayView<PeSectionHeader> Sections() const;
+	// Raw data of section `index` (SizeOfRawData bytes).
+	const char* SectionData(uint index) const;
+	const PeSectionHeader& SectionFromRVA(RVA rva) const;
+	const PeDataDirectory& Directory(uint index) const;
+	RVA NextFreeRVA() const;
+	bool IsAddrReadable(RVA rva) const;
+	bool IsAddrWritable(RVA rva) const;
+	bool IsAddrExecutable(RVA rva) const;
+	// Pointer to `size` bytes of file data at `rva`. Fails if they aren't all backed by
+	// raw data of a single section.
+	const char* Pointer(RVA rva, uint size) const;
+	std::string ReadString(RVA rva) const;
+
+	template<typename TO, typename FROM>
+	TO ConvertTo(FROM from) const;
+};
+
+template<> inline RVA PEView::ConvertTo<RVA, RVA>(RVA from) const
+{
+	return from;
+}
+
+template<> inline RVA PEView::ConvertTo<RVA, VA>(VA from) const
+{
+	const auto& optional = OptionalHeader();
+	if (from.val < optional.ImageBase || from.val >= optional.ImageBase + optional.SizeOfImage)
+		fatal_error("Invalid argument passed to %s! VA=%08x)", __FUNCTION__, from.val);
+	return RVA{ from.val - optional.ImageBase };
+}
+
+template<> inline RVA PEView::ConvertTo<RVA, FILE_OFFSET>(FILE_OFFSET from) const
+{
+	for (const auto& hdr : Sections())
+		if (hdr.PointerToRawData <= from.val
+			&& from.val < hdr.PointerToRawData + hdr.SizeOfRawData)
+		{
+			return RVA{ from.val + hdr.VirtualAddress - hdr.PointerToRawData };
+		}
+	fatal_error("Bad argument passed to %s! (FILE_OFFSET=%08x)", __FUNCTION__, from.val);
+}
+
+template<> inline VA PEView::ConvertTo<VA, RVA>(RVA from) const
+{
+	if (from.val >= OptionalHeader().SizeOfImage)
+		fatal_error("Invalid argument passed to %s! RVA=%08x)", __FUNCTION__, from.val);
+	return VA{ from.val + OptionalHeader().ImageBase };
+}
+
+template<> inline FILE_OFFSET PEView::ConvertTo<FILE_OFFSET, RVA>(RVA from) const
+{
+	const auto& hdr = SectionFromRVA(from);
+	if (from.val - hdr.VirtualAddress >= hdr.SizeOfRawData)
+		fatal_error("Bad argument passed to %s! (RVA=%08x)", __FUNCTION__, from.val);
+	return FILE_OFFSET{ from.val - hdr.VirtualAddress + hdr.PointerToRawData };
+}
+
+// `FROM` -> RVA -> `TO`
+template<typename TO, typename FROM> TO PEView::ConvertTo(FROM from) const
+{
+	return PEView::ConvertTo<TO>(PEView::ConvertTo<RVA>(from));
+}
+
+class PEEdit
+{
+	struct Section
+	{
+		PeSectionHeader header;
+		const char* data; // Points either into the view or into `owned`
+		std::shared_ptr<const std::string> owned;
+	};
+
+	std::shared_ptr<const PEView> view;
+	PeDosHeader MZ_header;
+	PeNtHeaders32 PE_header;
+	std::vector<Section> sections;
+	// Patched bytes, keyed by RVA. Ranges never overlap or touch each other.
+	std::map<uint, std::string> patches;
+
+	// Section whose raw data contains `size` bytes at `rva`, or nullptr.
+	const Section* RawSection(RVA rva, uint size) const;
+	std::string BuildHeaders();
+	template<typename F> void ForEachChunk(const std::string& headers, F callback) const;
+
+public:
+	explicit PEEdit(std::shared_ptr<const PEView> view);
+
+	const PEView& View() const;
+	const PeNtHeaders32& PeHeader() const;
+	PeNtHeaders32& PeHeader();
+	uint SectionCount() const;
+	const PeSectionHeader& SectionHeader(uint index) const;
+	// Returns -1 if there is no such section.
+	int FindSection(const std::string& name) const;
+
+	void AddSection(const std::string& name, RVA rva, uint vsize,
+	                const std::string& data, uint characteristics);
+	void RemoveSection(int index);
+	// Merges section `index` with the next one, which has to start right after its
+	// virtual end. The gap between them is filled with zeros. Keeps the first header.
+	void MergeWithNext(uint index);
+	// Cuts trailing zeros off raw data of section `index`, leaving them virtual-only.
+	// Returns the number of bytes removed.
+	uint TrimSection(uint index);
+	RVA NextFreeRVA() const;
+	void SetDirectory(uint index, RVA rva, uint size);
+	// Overwrites bytes at `rva`. They have to be backed by raw data of a single section.
+	void Patch(RVA rva, const void* data, uint size);
+	// Reads `size` bytes at `rva`, with patches applied. The same restrictions as for
+	// Patch() apply.
+	std::string Read(RVA rva, uint size) const;
+	const std::map<uint, std::string>& Patches() const;
+
+	std::string Build();
+	// Writes header fields and patches at their offsets in a copy of the original file,
+	// keeping its layout and any data after the last section (e.g. certificates). Fails
+	// if sections or the size of headers were changed.
+	std::string BuildInPlace() const;
+	void Write(std::ostream& out);
+	void Save(const std::wstring& file_path);
+};
+
+}
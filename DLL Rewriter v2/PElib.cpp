@@ -1,17 +1,16 @@
 #include "PElib.h"
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <limits>
 
 #include "common.h"
 
-#ifdef max // garbage from Windows.h
-#undef max
-#endif
-
 using std::ios;
 using std::numeric_limits;
 using std::map;
+using std::min;
 using std::ifstream;
 using std::ofstream;
 using std::string;
@@ -103,12 +102,12 @@ void PE::Load(const void* pe_data)
 	mem_it += header_size + PE_header.FileHeader.SizeOfOptionalHeader;
 
 	// Section headers
-	if (PE_header.OptionalHeader.NumberOfRvaAndSizes > IMAGE_NUMBEROF_DIRECTORY_ENTRIES)
+	if (PE_header.OptionalHeader.NumberOfRvaAndSizes > pe_directory_entries)
 		fatal_error("Bad value of field PE.OptionalHeader.NumberOfRvaAndSizes: %d",
 					PE_header.OptionalHeader.NumberOfRvaAndSizes);
 	for (int i = 0; i < PE_header.FileHeader.NumberOfSections; i++)
 	{
-		sections_hdrs.push_back(*(IMAGE_SECTION_HEADER*)mem_it);
+		sections_hdrs.push_back(*(PeSectionHeader*)mem_it);
 		char* ptr = new char[sections_hdrs.back().SizeOfRawData];
 		memcpy(ptr,
 			   mem_begin + sections_hdrs.back().PointerToRawData,
@@ -120,14 +119,14 @@ void PE::Load(const void* pe_data)
 }
 
 void PE::AddSection(const string& name, RVA rva, uint vsize, const string& data,
-					DWORD characteristics)
+					uint characteristics)
 {
-	IMAGE_SECTION_HEADER hdr;
+	PeSectionHeader hdr;
 	memset(&hdr, 0, sizeof(hdr));
 	memcpy(hdr.Name, name.c_str(), min(sizeof(hdr.Name), name.size()));
 	hdr.Characteristics = characteristics;
 	hdr.VirtualAddress = rva.val;
-	hdr.Misc.VirtualSize = vsize;
+	hdr.VirtualSize = vsize;
 	hdr.SizeOfRawData = data.size();
 	sections_hdrs.push_back(hdr);
 
@@ -147,44 +146,44 @@ void PE::RemoveSection(int index)
 RVA PE::NextFreeRVA() const
 {
 	return RVA{ sections_hdrs.back().VirtualAddress +
-		align_up(sections_hdrs.back().Misc.VirtualSize,
+		align_up(sections_hdrs.back().VirtualSize,
 				 PE_header.OptionalHeader.SectionAlignment) };
 }
 
-const IMAGE_SECTION_HEADER& PE::SectionFromRVA(RVA rva) const
+const PeSectionHeader& PE::SectionFromRVA(RVA rva) const
 {
 	for (auto& header : sections_hdrs)
 		if (header.VirtualAddress <= rva.val
-			&& rva.val < header.VirtualAddress + header.Misc.VirtualSize)
+			&& rva.val < header.VirtualAddress + header.VirtualSize)
 		{
 			return header;
 		}
-	fatal_error("Bad argument passed to " __FUNCTION__ "! (RVA=%08x)", rva);
+	fatal_error("Bad argument passed to %s! (RVA=%08x)", __FUNCTION__, rva);
 }
 
-const IMAGE_DATA_DIRECTORY& PE::Directory(uint index) const
+const PeDataDirectory& PE::Directory(uint index) const
 {
 	if (index >= PE_header.OptionalHeader.NumberOfRvaAndSizes)
-		fatal_error("Bad argument passed to " __FUNCTION__ "! (index=%08x)", index);
+		fatal_error("Bad argument passed to %s! (index=%08x)", __FUNCTION__, index);
 	return PE_header.OptionalHeader.DataDirectory[index];
 }
 
-const IMAGE_DOS_HEADER& PE::MzHeader() const
+const PeDosHeader& PE::MzHeader() const
 {
 	return MZ_header;
 }
 
-const IMAGE_NT_HEADERS& PE::PeHeader() const
+const PeNtHeaders32& PE::PeHeader() const
 {
 	return PE_header;
 }
 
-const IMAGE_FILE_HEADER& PE::FileHeader() const
+const PeFileHeader& PE::FileHeader() const
 {
 	return PE_header.FileHeader;
 }
 
-const IMAGE_OPTIONAL_HEADER& PE::OptionalHeader() const
+const PeOptionalHeader32& PE::OptionalHeader() const
 {
 	return PE_header.OptionalHeader;
 }
@@ -192,34 +191,34 @@ const IMAGE_OPTIONAL_HEADER& PE::OptionalHeader() const
 bool PE::IsAddrReadable(RVA rva) const
 {
 	const auto& section = SectionFromRVA(rva);
-	return (section.Characteristics & IMAGE_SCN_MEM_READ) != 0;
+	return (section.Characteristics & pe_scn_mem_read) != 0;
 }
 
 bool PE::IsAddrWritable(RVA rva) const
 {
 	const auto& section = SectionFromRVA(rva);
-	return (section.Characteristics & IMAGE_SCN_MEM_WRITE) != 0;
+	return (section.Characteristics & pe_scn_mem_write) != 0;
 }
 
 bool PE::IsAddrExecutable(RVA rva) const
 {
 	const auto& section = SectionFromRVA(rva);
-	return (section.Characteristics & IMAGE_SCN_MEM_EXECUTE) != 0;
+	return (section.Characteristics & pe_scn_mem_execute) != 0;
 }
 
 void PE::Save(const std::wstring& file_path)
 {
 	// Fix pointers
 	MZ_header.e_lfanew = sizeof(MZ_header) + dos_stub_size;
-	if (sections_hdrs.size() > numeric_limits<WORD>::max())
+	if (sections_hdrs.size() > numeric_limits<ushort>::max())
 		fatal_error("Too many sections! (%zd)", sections_hdrs.size());
-	PE_header.FileHeader.NumberOfSections = (WORD)sections_hdrs.size();
+	PE_header.FileHeader.NumberOfSections = (ushort)sections_hdrs.size();
 	PE_header.FileHeader.SizeOfOptionalHeader = sizeof(PE_header.OptionalHeader);
 	PE_header.OptionalHeader.FileAlignment = 0x200;
 	PE_header.OptionalHeader.SectionAlignment = 0x1000;
-	PE_header.OptionalHeader.NumberOfRvaAndSizes = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+	PE_header.OptionalHeader.NumberOfRvaAndSizes = pe_directory_entries;
 	PE_header.OptionalHeader.SizeOfImage =
-		align_up(sections_hdrs.back().VirtualAddress + sections_hdrs.back().Misc.VirtualSize,
+		align_up(sections_hdrs.back().VirtualAddress + sections_hdrs.back().VirtualSize,
 				 PE_header.OptionalHeader.SectionAlignment);
 	PE_header.OptionalHeader.SizeOfHeaders =
 		align_up(MZ_header.e_lfanew + sizeof(PE_header.Signature) + sizeof(PE_header.FileHeader)
@@ -260,12 +259,12 @@ void PE::Save(const std::wstring& file_path)
 
 	// Fix PE checksum
 	auto checksum_ptr = &res[checksum_pos];
-	memset(checksum_ptr, 0, sizeof(DWORD));
-	DWORD new_checksum = Checksum(res);
-	memcpy(checksum_ptr, &new_checksum, sizeof(DWORD));
+	memset(checksum_ptr, 0, sizeof(uint));
+	uint new_checksum = Checksum(res);
+	memcpy(checksum_ptr, &new_checksum, sizeof(uint));
 
 	// Write to file
-	ofstream f(file_path, ios::binary);
+	ofstream f(native_path(file_path), ios::binary);
 	if (f.fail())
 		fatal_error("Cannot open file: %ls", file_path.c_str());
 	f << res;
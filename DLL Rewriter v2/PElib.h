@@ -8,9 +8,8 @@ This library provides `PE` class which allows simple operations on 32-bit PE fil
 #include <string>
 #include <vector>
 
-#include <Windows.h>
-
 #include "common.h"
+#include "PEFormat.h"
 
 namespace PElib
 {
@@ -25,9 +24,9 @@ class PE
 	bool sections_loaded;
 	char* stub;
 	uint dos_stub_size;
-	IMAGE_DOS_HEADER MZ_header;
-	IMAGE_NT_HEADERS PE_header;
-	std::vector<IMAGE_SECTION_HEADER> sections_hdrs;
+	PeDosHeader MZ_header;
+	PeNtHeaders32 PE_header;
+	std::vector<PeSectionHeader> sections_hdrs;
 	std::vector<char*> sections_data;
 
 	void Load(const std::wstring& path);
@@ -44,15 +43,15 @@ public:
 	virtual ~PE();
 
 	void AddSection(const std::string& name, RVA rva, uint vsize,
-					const std::string& data, DWORD characteristics);
+					const std::string& data, uint characteristics);
 	void RemoveSection(int index);
 	RVA NextFreeRVA() const;
-	const IMAGE_SECTION_HEADER& SectionFromRVA(RVA rva) const;
-	const IMAGE_DATA_DIRECTORY& Directory(uint index) const;
-	const IMAGE_DOS_HEADER& MzHeader() const;
-	const IMAGE_NT_HEADERS& PeHeader() const;
-	const IMAGE_FILE_HEADER& FileHeader() const;
-	const IMAGE_OPTIONAL_HEADER& OptionalHeader() const;
+	const PeSectionHeader& SectionFromRVA(RVA rva) const;
+	const PeDataDirectory& Directory(uint index) const;
+	const PeDosHeader& MzHeader() const;
+	const PeNtHeaders32& PeHeader() const;
+	const PeFileHeader& FileHeader() const;
+	const PeOptionalHeader32& OptionalHeader() const;
 	bool IsAddrReadable(RVA rva) const;
 	bool IsAddrWritable(RVA rva) const;
 	bool IsAddrExecutable(RVA rva) const;
@@ -76,7 +75,7 @@ template<> inline RVA PE::ConvertTo<RVA, VA>(VA from)
 {
 	if (from.val < PE_header.OptionalHeader.ImageBase
 		|| from.val >= PE_header.OptionalHeader.ImageBase + PE_header.OptionalHeader.SizeOfImage)
-		fatal_error("Invalid argument passed to " __FUNCTION__ "! VA=%08x)", from);
+		fatal_error("Invalid argument passed to %s! VA=%08x)", __FUNCTION__, from);
 	return RVA{ from.val - PE_header.OptionalHeader.ImageBase };
 }
 
@@ -88,7 +87,7 @@ template<> inline RVA PE::ConvertTo<RVA, FILE_OFFSET>(FILE_OFFSET from)
 		{
 			return RVA{ from.val + hdr.VirtualAddress - hdr.PointerToRawData };
 		}
-	fatal_error("Bad argument passed to " __FUNCTION__ "! (FILE_OFFSET=%08x)", from.val);
+	fatal_error("Bad argument passed to %s! (FILE_OFFSET=%08x)", __FUNCTION__, from.val);
 }
 
 template<> inline RVA PE::ConvertTo<RVA, PTR>(PTR from)
@@ -97,9 +96,9 @@ template<> inline RVA PE::ConvertTo<RVA, PTR>(PTR from)
 		if (sections_data[i] <= from.val
 			&& from.val < sections_data[i] + sections_hdrs[i].SizeOfRawData)
 		{
-			return RVA{ from.val - sections_data[i] + sections_hdrs[i].VirtualAddress };
+			return RVA{ (uint)(from.val - sections_data[i]) + sections_hdrs[i].VirtualAddress };
 		}
-	fatal_error("Bad argument passed to " __FUNCTION__ "! (PTR=%08x)", from.val);
+	fatal_error("Bad argument passed to %s! (PTR=%08x)", __FUNCTION__, from.val);
 }
 
 //--------------------------------------------------------
@@ -109,7 +108,7 @@ template<> inline RVA PE::ConvertTo<RVA, PTR>(PTR from)
 template<> inline VA PE::ConvertTo<VA, RVA>(RVA from)
 {
 	if (from.val >= PE_header.OptionalHeader.SizeOfImage)
-		fatal_error("Invalid argument passed to " __FUNCTION__ "! RVA=%08x)", from);
+		fatal_error("Invalid argument passed to %s! RVA=%08x)", __FUNCTION__, from);
 	return VA{ from.val + PE_header.OptionalHeader.ImageBase };
 }
 
@@ -117,22 +116,22 @@ template<> inline FILE_OFFSET PE::ConvertTo<FILE_OFFSET, RVA>(RVA from)
 {
 	for (const auto& hdr : sections_hdrs)
 		if (hdr.VirtualAddress <= from.val
-			&& from.val < hdr.VirtualAddress + hdr.Misc.VirtualSize)
+			&& from.val < hdr.VirtualAddress + hdr.VirtualSize)
 		{
 			return FILE_OFFSET{ from.val - hdr.VirtualAddress + hdr.PointerToRawData };
 		}
-	fatal_error("Bad argument passed to " __FUNCTION__ "! (RVA=%08x)", from.val);
+	fatal_error("Bad argument passed to %s! (RVA=%08x)", __FUNCTION__, from.val);
 }
 
 template<> inline PTR PE::ConvertTo<PTR, RVA>(RVA from)
 {
 	for (size_t i = 0; i < sections_hdrs.size(); i++)
 		if (sections_hdrs[i].VirtualAddress <= from.val
-			&& from.val < sections_hdrs[i].VirtualAddress + sections_hdrs[i].Misc.VirtualSize)
+			&& from.val < sections_hdrs[i].VirtualAddress + sections_hdrs[i].VirtualSize)
 		{
 			return PTR{ sections_data[i] + (from.val - sections_hdrs[i].VirtualAddress) };
 		}
-	fatal_error("Bad argument passed to " __FUNCTION__ "! (RVA=%08x)", from.val);
+	fatal_error("Bad argument passed to %s! (RVA=%08x)", __FUNCTION__, from.val);
 }
 
 // `FROM` -> RVA -> `TO`
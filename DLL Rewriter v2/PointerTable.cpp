@@ -0,0 +1,51 @@
+#include "PointerTable.h"
+
+#include <cstring>
+
+#include "PointerTableFormat.h"
+
+using std::string;
+using std::vector;
+
+namespace PElib
+{
+
+static const char table_magic[8] = { 'D', 'L', 'L', 'R', 'P', 'T', 'R', 'S' };
+static const uint table_version = 1;
+static const uint slots_alignment = 64;
+
+RVA PointerTableSlots(RVA rva)
+{
+	return RVA{ rva.val + (uint)align_up(sizeof(PointerTableHeader), slots_alignment) };
+}
+
+string BuildPointerTable(RVA rva, uint image_base, uint ordinal_base,
+                         const vector<RVA>& targets, vector<RVA>* fixups)
+{
+	PointerTableHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, table_magic, sizeof(header.magic));
+	header.version = table_version;
+	header.slot_size = sizeof(uint);
+	header.slot_count = targets.size();
+	header.ordinal_base = ordinal_base;
+	header.slots_offset = PointerTableSlots(rva).val - rva.val;
+	header.defaults_offset = align_up(header.slots_offset + targets.size() * header.slot_size,
+	                                  slots_alignment);
+
+	string res(header.defaults_offset + targets.size() * sizeof(uint), '\0');
+	memcpy(&res[0], &header, sizeof(header));
+	for (size_t i = 0; i < targets.size(); i++)
+	{
+		if (!targets[i].val)
+			continue;
+		uint slot_offset = header.slots_offset + i * header.slot_size;
+		uint va = image_base + targets[i].val;
+		memcpy(&res[slot_offset], &va, sizeof(va));
+		memcpy(&res[header.defaults_offset + i * sizeof(uint)], &targets[i].val, sizeof(uint));
+		fixups->push_back(RVA{ rva.val + slot_offset });
+	}
+	return res;
+}
+
+}
@@ -0,0 +1,25 @@
+/*
+Builds the pointer table read by pointer_jmp.asm wrappers (see PointerTableFormat.h).
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "PElib.h"
+#include "PEView.h"
+
+namespace PElib
+{
+
+// Serializes the table for an image based at `image_base` as if it was placed at `rva`.
+// `targets` are indexed like AddressOfFunctions, 0 for exports without a slot. RVAs of
+// slots which need base relocations are appended to `fixups`.
+std::string BuildPointerTable(RVA rva, uint image_base, uint ordinal_base,
+                              const std::vector<RVA>& targets, std::vector<RVA>* fixups);
+// RVA of slot 0 in a table placed at `rva`.
+RVA PointerTableSlots(RVA rva);
+
+}
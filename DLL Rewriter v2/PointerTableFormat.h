@@ -0,0 +1,46 @@
+/*
+Layout of the "ptrtable" section used by pointer_jmp.asm wrappers. Doesn't depend on
+Windows headers, so components switching targets at runtime can include it anywhere.
+All integers are little-endian.
+
+The section starts with `PointerTableHeader`, followed by:
+	slots[slot_count]     at slots_offset, each slot_size bytes (4 in PE32 images)
+	defaults[slot_count]  at defaults_offset, uint32_t RVAs
+Slot i belongs to the export with ordinal (ordinal_base + i), i.e. the same index as in
+AddressOfFunctions. It holds the VA the export's wrapper jumps to, initially the original
+function (relocated by the loader together with the image). `defaults` keep the original
+targets as RVAs, so they can be restored. Exports which aren't redirected (forwarders,
+data) have 0 in both.
+
+Slots are naturally aligned (the whole array starts at a 64-byte boundary), so a target
+is switched atomically with a single aligned store of slot_size bytes, e.g.
+InterlockedExchange(), while other threads are calling the export: every call goes
+either to the old or to the new target. The old target has to stay valid until no thread
+can be executing it anymore. The section is writable, no VirtualProtect() is needed.
+The table is found by its section name in the loaded module's headers.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+namespace PElib
+{
+
+#pragma pack(push, 1)
+struct PointerTableHeader
+{
+	char magic[8];            // "DLLRPTRS"
+	uint32_t version;         // 1
+	uint32_t slot_size;       // Size of a pointer in the image
+	uint32_t slot_count;      // NumberOfFunctions of the export directory
+	uint32_t ordinal_base;    // Ordinal of the export using slot 0
+	uint32_t slots_offset;    // From the start of the header
+	uint32_t defaults_offset; // From the start of the header
+	uint32_t reserved[8];
+};
+#pragma pack(pop)
+
+static_assert(sizeof(PointerTableHeader) == 64, "PointerTableHeader has to be 64 bytes");
+
+}
@@ -0,0 +1,92 @@
+#include "Profile.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+using std::string;
+using std::vector;
+
+namespace PElib
+{
+
+static const char profile_magic[8] = { 'D', 'L', 'L', 'R', 'P', 'R', 'O', 'F' };
+static const uint profile_version = 1;
+
+static uint profile_index(const ExportIndex& exports, const Export* exp, const string& symbol)
+{
+	if (!exp)
+		fatal_error("Profile refers to unknown export: %s", symbol.c_str());
+	return exp->ordinal - exports.Directory().Base;
+}
+
+static ExportProfile parse_binary_profile(const string& data, const ExportIndex& exports)
+{
+	ProfileHeader header;
+	if (data.size() < sizeof(header))
+		fatal_error("Profile too short");
+	memcpy(&header, data.data(), sizeof(header));
+	if (header.version != profile_version)
+		fatal_error("Unsupported profile version: %d", header.version);
+	if ((data.size() - sizeof(header)) / sizeof(ProfileRecord) < header.count)
+		fatal_error("Profile too short (%d records declared)", header.count);
+
+	ExportProfile res;
+	for (uint i = 0; i < header.count; i++)
+	{
+		ProfileRecord record;
+		memcpy(&record, data.data() + sizeof(header) + i * sizeof(record), sizeof(record));
+		auto symbol = format("#%d", record.ordinal);
+		res[profile_index(exports, exports.FindByOrdinal(record.ordinal), symbol)] += record.count;
+	}
+	return res;
+}
+
+static ExportProfile parse_text_profile(const string& data, const ExportIndex& exports)
+{
+	ExportProfile res;
+	std::istringstream stream(data);
+	string line;
+	uint line_no = 0;
+	while (std::getline(stream, line))
+	{
+		line_no++;
+		std::istringstream line_stream(line);
+		string symbol;
+		ull count;
+		if (!(line_stream >> symbol) || symbol[0] == ';')
+			continue;
+		if (!(line_stream >> count))
+			fatal_error("Invalid profile entry in line %d", line_no);
+
+		const Export* exp;
+		if (symbol[0] == '#')
+			exp = exports.FindByOrdinal((uint)strtoul(symbol.c_str() + 1, nullptr, 10));
+		else
+			exp = exports.FindByName(symbol);
+		res[profile_index(exports, exp, symbol)] += count;
+	}
+	return res;
+}
+
+ExportProfile ParseProfile(const string& data, const ExportIndex& exports)
+{
+	if (data.size() >= sizeof(profile_magic)
+		&& memcmp(data.data(), profile_magic, sizeof(profile_magic)) == 0)
+		return parse_binary_profile(data, exports);
+	return parse_text_profile(data, exports);
+}
+
+void OrderByProfile(vector<uint>& indexes, const ExportProfile& profile)
+{
+	auto count = [&profile](uint index) -> ull
+	{
+		auto it = profile.find(index);
+		return it == profile.end() ? 0 : it->second;
+	};
+	std::stable_sort(indexes.begin(), indexes.end(),
+	                 [&](uint a, uint b) { return count(a) > count(b); });
+}
+
+}
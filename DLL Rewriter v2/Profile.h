@@ -0,0 +1,52 @@
+/*
+Per-export call counts, used to lay out wrappers so that the hot ones are packed together
+(sharing cache lines and the first page of the section).
+
+Text format, one export per line:
+	<name> <count>
+	#<ordinal> <count>
+Empty lines and lines starting with ';' are ignored.
+
+Binary format (all integers are little-endian):
+	ProfileHeader header;
+	ProfileRecord records[header.count];
+*/
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "Exports.h"
+
+namespace PElib
+{
+
+#pragma pack(push, 1)
+struct ProfileHeader
+{
+	char magic[8]; // "DLLRPROF"
+	uint version;  // 1
+	uint count;    // Number of records
+};
+
+struct ProfileRecord
+{
+	uint ordinal;  // Biased ordinal
+	ull count;
+};
+#pragma pack(pop)
+
+// Call counts keyed by export index (in AddressOfFunctions). Counts of exports listed
+// multiple times are summed.
+typedef std::map<uint, ull> ExportProfile;
+
+// Parses profile in either format (detected by the magic).
+ExportProfile ParseProfile(const std::string& data, const ExportIndex& exports);
+// Sorts export indexes by call count, hottest first. Order of exports with equal counts
+// (including ones missing in the profile) is preserved.
+void OrderByProfile(std::vector<uint>& indexes, const ExportProfile& profile);
+
+}
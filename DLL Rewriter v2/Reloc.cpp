@@ -0,0 +1,213 @@
+#include "Reloc.h"
+
+#include <algorithm>
+#include <cstring>
+
+using std::min;
+using std::string;
+using std::vector;
+
+namespace PElib
+{
+
+static const uint page_size = 0x1000;
+static const uint base_alignment = 0x10000;
+
+static vector<RelocBlock> parse_blocks(const char* data, uint size, uint dir_rva)
+{
+	vector<RelocBlock> res;
+	uint pos = 0;
+	while (pos + sizeof(PeBaseRelocation) <= size)
+	{
+		PeBaseRelocation block_header;
+		memcpy(&block_header, data + pos, sizeof(block_header));
+		if (block_header.SizeOfBlock < sizeof(block_header)
+			|| block_header.SizeOfBlock > size - pos)
+			fatal_error("Invalid relocation block size at RVA=%08x", dir_rva + pos);
+		RelocBlock block;
+		block.page = RVA{ block_header.VirtualAddress };
+		block.entries.resize((block_header.SizeOfBlock - sizeof(block_header)) / sizeof(ushort));
+		memcpy(block.entries.data(), data + pos + sizeof(block_header),
+		       block.entries.size() * sizeof(ushort));
+		res.push_back(std::move(block));
+		pos += block_header.SizeOfBlock;
+	}
+	return res;
+}
+
+vector<RelocBlock> ParseRelocations(const PEView& pe)
+{
+	const auto& reloc_dir_entry = pe.Directory(pe_directory_basereloc);
+	if (!reloc_dir_entry.VirtualAddress || !reloc_dir_entry.Size)
+		return {}; // No relocations
+	return parse_blocks(pe.Pointer(RVA{ reloc_dir_entry.VirtualAddress }, reloc_dir_entry.Size),
+	                    reloc_dir_entry.Size, reloc_dir_entry.VirtualAddress);
+}
+
+vector<RelocBlock> ParseRelocations(const PEEdit& pe)
+{
+	const auto& reloc_dir_entry =
+		pe.PeHeader().OptionalHeader.DataDirectory[pe_directory_basereloc];
+	if (!reloc_dir_entry.VirtualAddress || !reloc_dir_entry.Size)
+		return {};
+	string data = pe.Read(RVA{ reloc_dir_entry.VirtualAddress }, reloc_dir_entry.Size);
+	return parse_blocks(data.data(), data.size(), reloc_dir_entry.VirtualAddress);
+}
+
+string BuildRelocations(const vector<RelocBlock>& blocks)
+{
+	string res;
+	for (const auto& block : blocks)
+	{
+		// Blocks have to be 32-bit aligned, so odd entry counts are padded with ABSOLUTE.
+		uint entries_size = align_up(block.entries.size() * sizeof(ushort), sizeof(uint));
+		PeBaseRelocation header;
+		header.VirtualAddress = block.page.val;
+		header.SizeOfBlock = sizeof(header) + entries_size;
+		res.append((const char*)&header, sizeof(header));
+		res.append((const char*)block.entries.data(), block.entries.size() * sizeof(ushort));
+		res.resize(res.size() + entries_size - block.entries.size() * sizeof(ushort), '\0');
+	}
+	return res;
+}
+
+void AddRelocations(PEEdit& pe, vector<RVA> fixups, const vector<RVA>& removed)
+{
+	if (fixups.empty() && removed.empty())
+		return;
+	auto blocks = ParseRelocations(pe);
+	if (!removed.empty())
+	{
+		vector<uint> sorted_removed;
+		for (RVA rva : removed)
+			sorted_removed.push_back(rva.val);
+		std::sort(sorted_removed.begin(), sorted_removed.end());
+		// Padding is dropped too, BuildRelocations() adds it back where needed.
+		for (auto& block : blocks)
+		{
+			auto is_removed = [&](ushort entry)
+			{
+				return (entry >> 12) == pe_rel_based_absolute
+					|| std::binary_search(sorted_removed.begin(), sorted_removed.end(),
+					                      block.page.val + (entry & 0xFFF));
+			};
+			block.entries.erase(std::remove_if(block.entries.begin(), block.entries.end(),
+			                                   is_removed),
+			                    block.entries.end());
+		}
+		blocks.erase(std::remove_if(blocks.begin(), blocks.end(),
+		                            [](const RelocBlock& block) { return block.entries.empty(); }),
+		             blocks.end());
+	}
+	std::sort(fixups.begin(), fixups.end(), [](RVA a, RVA b) { return a.val < b.val; });
+	for (RVA fixup : fixups)
+	{
+		uint page = align_down(fixup.val, page_size);
+		if (blocks.empty() || blocks.back().page.val != page)
+			blocks.push_back(RelocBlock{ RVA{ page }, {} });
+		blocks.back().entries.push_back(
+			(ushort)(pe_rel_based_highlow << 12 | (fixup.val - page)));
+	}
+
+	// A directory written by an earlier call would be dead weight, so replace it if nothing
+	// was added after it.
+	int last = (int)pe.SectionCount() - 1;
+	uint dir_rva = pe.PeHeader().OptionalHeader.DataDirectory[pe_directory_basereloc]
+		.VirtualAddress;
+	if (last >= 0 && pe.SectionHeader(last).VirtualAddress == dir_rva
+		&& strncmp((const char*)pe.SectionHeader(last).Name, "relocs", pe_section_name_size) == 0)
+		pe.RemoveSection(last);
+
+	auto rva = pe.NextFreeRVA();
+	string data = BuildRelocations(blocks);
+	pe.AddSection("relocs",
+	              rva,
+	              align_up(data.size(), pe.PeHeader().OptionalHeader.SectionAlignment),
+	              data,
+	              pe_scn_cnt_initialized_data | pe_scn_mem_discardable | pe_scn_mem_read);
+	pe.SetDirectory(pe_directory_basereloc, rva, data.size());
+}
+
+// Applies fixups of one block to a copy of its page (plus 3 bytes, as the last fixup
+// may cross the page boundary).
+static void rebase_block(PEEdit& pe, const RelocBlock& block, uint delta)
+{
+	if (block.entries.empty())
+		return;
+	uint raw_end = 0;
+	for (uint i = 0; i < pe.SectionCount(); i++)
+	{
+		const auto& header = pe.SectionHeader(i);
+		if (header.VirtualAddress <= block.page.val
+			&& block.page.val < header.VirtualAddress + header.SizeOfRawData)
+		{
+			raw_end = header.VirtualAddress + header.SizeOfRawData;
+			break;
+		}
+	}
+	if (!raw_end)
+		fatal_error("Relocated page outside of section data (RVA=%08x)", block.page.val);
+	uint span = min(raw_end - block.page.val, page_size + (uint)sizeof(uint) - 1);
+
+	// Validate the whole block first, so the loop below doesn't need any branches.
+	// ABSOLUTE entries are padding, they are applied at offset 0 with zero delta.
+	bool bad = span < sizeof(uint);
+	for (ushort entry : block.entries)
+	{
+		uint type = entry >> 12;
+		uint offset = entry & 0xFFF;
+		bad |= type != pe_rel_based_highlow && type != pe_rel_based_absolute;
+		bad |= type == pe_rel_based_highlow && offset + sizeof(uint) > span;
+	}
+	if (bad)
+		fatal_error("Unsupported relocations in block for RVA=%08x", block.page.val);
+
+	string page = pe.Read(block.page, span);
+	char* data = &page[0];
+	for (ushort entry : block.entries)
+	{
+		uint mask = 0u - (uint)((entry >> 12) == pe_rel_based_highlow);
+		uint offset = entry & 0xFFF & mask;
+		uint value;
+		memcpy(&value, data + offset, sizeof(value));
+		value += delta & mask;
+		memcpy(data + offset, &value, sizeof(value));
+	}
+	pe.Patch(block.page, page.data(), span);
+}
+
+void Rebase(PEEdit& pe, uint new_base)
+{
+	auto& optional_header = pe.PeHeader().OptionalHeader;
+	if (new_base % base_alignment)
+		fatal_error("Image base has to be aligned to 64 KiB (%08x)", new_base);
+	if ((ull)new_base + optional_header.SizeOfImage > 0x100000000ull)
+		fatal_error("Image doesn't fit at base %08x", new_base);
+	if (new_base == optional_header.ImageBase)
+		return;
+	if (pe.PeHeader().FileHeader.Characteristics & pe_file_relocs_stripped)
+		fatal_error("Relocations were stripped from this image, it can't be rebased");
+
+	uint delta = new_base - optional_header.ImageBase;
+	for (const auto& block : ParseRelocations(pe))
+		rebase_block(pe, block, delta);
+	optional_header.ImageBase = new_base;
+	// Like ReBaseImage(): importers bound to the old base must see a different stamp.
+	pe.PeHeader().FileHeader.TimeDateStamp++;
+}
+
+vector<uint> PlanBases(const vector<uint>& image_sizes, uint start, uint end)
+{
+	vector<uint> res;
+	ull base = align_up((ull)start, base_alignment);
+	for (uint size : image_sizes)
+	{
+		if (base + size > end)
+			fatal_error("Images don't fit between %08x and %08x", start, end);
+		res.push_back((uint)base);
+		base = align_up(base + size, base_alignment);
+	}
+	return res;
+}
+
+}
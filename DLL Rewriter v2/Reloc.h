@@ -0,0 +1,46 @@
+/*
+Base relocations: parsing, rebasing an image to a new preferred ImageBase, and planning
+non-overlapping bases for a set of DLLs, so the loader doesn't have to relocate them.
+Only pe_rel_based_highlow fixups (and ABSOLUTE padding) are supported, which is
+everything a PE32 image uses.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "PElib.h"
+#include "PEView.h"
+
+namespace PElib
+{
+
+struct RelocBlock
+{
+	RVA page;
+	std::vector<ushort> entries; // Type in the top 4 bits, offset in the page in the rest
+};
+
+// Returns an empty vector if there is no relocation directory.
+std::vector<RelocBlock> ParseRelocations(const PEView& pe);
+// The same, but for the current (possibly already rewritten) directory.
+std::vector<RelocBlock> ParseRelocations(const PEEdit& pe);
+
+// Serializes blocks into a relocation directory.
+std::string BuildRelocations(const std::vector<RelocBlock>& blocks);
+// Adds HIGHLOW fixups at given addresses and drops the ones at `removed` addresses.
+// The whole relocation directory is rewritten into a new section.
+void AddRelocations(PEEdit& pe, std::vector<RVA> fixups, const std::vector<RVA>& removed = {});
+
+// Applies every fixup for moving the image to `new_base`, updates ImageBase and increments
+// TimeDateStamp, which invalidates bindings of importers. Sections are left as they are,
+// only their bytes are patched.
+void Rebase(PEEdit& pe, uint new_base);
+
+// Assigns consecutive 64 KiB-aligned bases from [start, end) to images with given
+// SizeOfImage values, so that none of them overlap.
+std::vector<uint> PlanBases(const std::vector<uint>& image_sizes, uint start, uint end);
+
+}
@@ -0,0 +1,663 @@
+#include "Rewriter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <thread>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Bind.h"
+#include "Compact.h"
+#include "DelayLoad.h"
+#include "Detour.h"
+#include "Exports.h"
+#include "InitTiming.h"
+#include "ModuleCache.h"
+#include "PEView.h"
+#include "PointerTable.h"
+#include "Profile.h"
+#include "Reloc.h"
+#include "TemplateRules.h"
+#include "ThunkSymbols.h"
+#include "TraceFormat.h"
+#include "WrappersMetadata.h"
+#include "common.h"
+
+using std::exception;
+using std::ios;
+using std::map;
+using std::ofstream;
+using std::string;
+using std::vector;
+using std::wstring;
+
+using PElib::ExportIndex;
+using PElib::ModuleCache;
+using PElib::PEEdit;
+using PElib::PEView;
+using PElib::RVA;
+
+namespace Rewriter
+{
+
+struct AssembledCode
+{
+	string code;
+	map<string, uint> labels;
+};
+
+// Private directory in %TEMP% (or $TMPDIR) for nasm's files, removed (with the files)
+// when destroyed. nasm can't read from a pipe or write its map file to one, so some files
+// are needed.
+class ScratchDir
+{
+	string path;
+	vector<string> files;
+
+public:
+	ScratchDir()
+	{
+		static std::atomic<uint> counter(0);
+#ifdef _WIN32
+		wchar_t temp[MAX_PATH + 1];
+		DWORD length = GetTempPathW(MAX_PATH + 1, temp);
+		if (!length || length > MAX_PATH)
+			fatal_error("Cannot get temporary directory path");
+		wstring temp_path(temp, length);
+		uint pid = (uint)GetCurrentProcessId();
+#else
+		const char* tmpdir = getenv("TMPDIR");
+		string temp_dir = tmpdir && *tmpdir ? tmpdir : "/tmp";
+		wstring temp_path = wstring(temp_dir.begin(), temp_dir.end()) + path_separator;
+		uint pid = (uint)getpid();
+#endif
+		for (uint attempt = 0; path.empty(); attempt++)
+		{
+			auto name = format("dllrewriter-%u-%u", pid, (uint)counter++);
+			auto dir = temp_path + wstring(name.begin(), name.end());
+#ifdef _WIN32
+			bool created = CreateDirectoryW(dir.c_str(), nullptr) != 0;
+#else
+			bool created = mkdir(native_path(dir).c_str(), 0700) == 0;
+#endif
+			if (created)
+				path = string(dir.begin(), dir.end());
+			else if (attempt == 100)
+				fatal_error("Cannot create scratch directory in %ls", temp_path.c_str());
+		}
+	}
+
+	~ScratchDir()
+	{
+#ifdef _WIN32
+		for (const auto& file : files)
+			DeleteFileW(wstring(file.begin(), file.end()).c_str());
+		RemoveDirectoryW(wstring(path.begin(), path.end()).c_str());
+#else
+		for (const auto& file : files)
+			unlink(file.c_str());
+		rmdir(path.c_str());
+#endif
+	}
+
+	const string& Path() const { return path; }
+
+	// Full path of `name`, which is removed with the directory.
+	string File(const string& name)
+	{
+		files.push_back(path + (char)path_separator + name);
+		return files.back();
+	}
+};
+
+// Defines `place_branch <size>`, used by templates before every branch instruction of
+// `size` bytes. It pads with nops only if the branch would cross `boundary` (or, for 32
+// bytes, end right at it, which the JCC erratum microcode also punishes). Offsets are
+// taken from the start of the code, which is page-aligned. 0 disables padding.
+static string placement_macros(uint boundary)
+{
+	if (boundary == 0)
+		return "%macro place_branch 1\n%endmacro\n";
+	uint ends_count = boundary == 32 ? 1 : 0;
+	return format("%%macro place_branch 1 ; Args: size of the branch which follows\n"
+	              "\ttimes (((($-$$) %% %d) + %%1 - 1 + %d) / %d) * (%d - (($-$$) %% %d)) nop\n"
+	              "%%endmacro\n",
+	              boundary, ends_count, boundary, boundary, boundary);
+}
+
+// Assembles `source` using nasm, as code to be placed at `rva`. Labels are read from
+// the map file, starting at `__begin_marker`. Files are named `name`.*, in the current
+// directory (and kept there) or in a private scratch directory.
+static AssembledCode assemble(RVA rva, const string& source, const string& name,
+                              const Options& options)
+{
+	std::unique_ptr<ScratchDir> scratch;
+	string asm_path = name + ".asm", bin_path = name + ".bin", map_path = name + ".map";
+	string command = format(R"(nasm "%s" -O0 -o "%s")", asm_path.c_str(), bin_path.c_str());
+	if (options.private_scratch)
+	{
+		// nasm is run from the scratch directory, so the map directive needs no path.
+		scratch.reset(new ScratchDir());
+#ifdef _WIN32
+		command = format(R"(cd /d "%s" && %s)", scratch->Path().c_str(), command.c_str());
+#else
+		command = format(R"(cd "%s" && %s)", scratch->Path().c_str(), command.c_str());
+#endif
+		asm_path = scratch->File(asm_path);
+		bin_path = scratch->File(bin_path);
+		map_path = scratch->File(map_path);
+	}
+
+	ofstream gen_file(asm_path, ios::binary);
+	gen_file << "[bits 32]\n";
+	gen_file << format("[org 0%08xh]\n", rva.val);
+	gen_file << "[map symbols " << name << ".map]\n";
+	gen_file << placement_macros(options.branch_boundary);
+	gen_file << source;
+	gen_file.close();
+	if (gen_file.fail())
+		fatal_error("Cannot write %s", asm_path.c_str());
+
+	// Compile generated code using nasm
+	// Using system() is generally a bad thing, but it's the simplest solution here.
+	if (system(command.c_str()) != 0)
+		fatal_error("nasm failed to assemble generated code");
+
+	AssembledCode res;
+	res.code = read_whole_file(bin_path);
+	res.labels = parse_map_file(map_path);
+	return res;
+}
+
+// Input DLL, parsed once and shared by all variants (neither is modified).
+struct ParsedDll
+{
+	std::shared_ptr<const PEView> view;
+	ExportIndex exports;
+
+	explicit ParsedDll(const string& dll_data)
+		: view(std::make_shared<const PEView>(dll_data)), exports(*view)
+	{
+	}
+};
+
+// `scratch` is the name of nasm's files. Unless they are private, it has to be different
+// for concurrent calls.
+static void rewrite(const ParsedDll& input, const Variant& variant, const string& scratch,
+                    const Options& options, Result& result)
+{
+	const auto& view = input.view;
+	const auto& redirect_source = variant.redirect_source;
+	PEEdit dll(view);
+	bool rebuild_exports = options.rebuild_exports;
+	if (options.branch_boundary != 0 && options.branch_boundary != 32 && options.branch_boundary != 64)
+		fatal_error("Unsupported branch boundary: %d (use 32 or 64)", options.branch_boundary);
+
+	// Parse export table
+	const auto& exports_dir_entry = view->Directory(PElib::pe_directory_export);
+	if (!exports_dir_entry.VirtualAddress || !exports_dir_entry.Size)
+		fatal_error("This DLL doesn't have an export table, nothing to do.");
+	ExportIndex exports = input.exports;
+	const auto& export_directory = exports.Directory();
+
+	// Find array with addresses of exported symbols
+	auto exported_functions = (const uint*)view->Pointer(RVA{ export_directory.AddressOfFunctions },
+	                                                     export_directory.NumberOfFunctions * sizeof(uint));
+
+	// If this DLL was already processed by us, wrap original functions again instead of
+	// wrapping the old wrappers. Old sections are dropped, so the result doesn't grow.
+	vector<RVA> originals(export_directory.NumberOfFunctions);
+	for (uint i = 0; i < export_directory.NumberOfFunctions; i++)
+		originals[i] = RVA{ exported_functions[i] };
+	int old_wrappers = dll.FindSection("wrappers");
+	if (old_wrappers >= 0)
+	{
+		// Detoured functions jump into the old wrappers and their original bytes are gone.
+		if (dll.FindSection("detours") >= 0)
+			fatal_error("This DLL has detours from a previous run, rewrite the original one");
+		vector<PElib::WrapperRecord> records;
+		if (!PElib::ReadWrappersMetadata(*view, old_wrappers, &records))
+			fatal_error("Section 'wrappers' already exists, but it wasn't created by this tool");
+		const auto& old_header = dll.SectionHeader(old_wrappers);
+		for (const auto& record : records)
+			if (record.index < originals.size())
+				originals[record.index] = RVA{ record.original_rva };
+		for (uint i = 0; i < export_directory.NumberOfFunctions; i++)
+			if (old_header.VirtualAddress <= originals[i].val
+				&& originals[i].val < old_header.VirtualAddress + old_header.VirtualSize)
+				fatal_error("Export #%d points to old wrappers, but has no metadata", i);
+		result.messages.push_back(
+			format("Replacing wrappers from a previous run (%zd functions).", records.size()));
+	}
+	// Entry point and TLS callbacks timed by a previous run point into old wrappers.
+	int old_init = old_wrappers >= 0 ? dll.FindSection("inittime") : -1;
+	if (old_init >= 0)
+		result.messages.push_back(format("Restored %d callbacks timed by a previous run.",
+		                                 PElib::RestoreInitCallbacks(dll, old_init)));
+	// Export directory rebuilt by a previous run is removed and written again.
+	int old_exports = dll.FindSection("exports");
+	if (old_exports >= 0
+		&& view->SectionFromRVA(RVA{ exports_dir_entry.VirtualAddress }).VirtualAddress
+		   != view->Sections()[old_exports].VirtualAddress)
+	{
+		old_exports = -1;
+	}
+	if (old_exports >= 0)
+		rebuild_exports = true;
+	// Hash of export names has RVAs of old wrappers, it's always dropped.
+	int old_hash = dll.FindSection("exphash");
+	// The same goes for bound import directory, if we're going to bind again.
+	int old_bound = options.bind ? dll.FindSection("bound") : -1;
+	// Trace buffers and pointer table belong to old wrappers.
+	int old_trace = old_wrappers >= 0 ? dll.FindSection("tracebuf") : -1;
+	int old_table = old_wrappers >= 0 ? dll.FindSection("ptrtable") : -1;
+	// Imports delay-loaded by a previous run are restored, they're converted again below
+	// if requested. Restored IAT slots lose their relocations.
+	vector<RVA> removed_fixups;
+	int old_delay_data = dll.FindSection("delaydat");
+	int old_delay_code = old_delay_data >= 0 ? dll.FindSection("delayimp") : -1;
+	if (old_delay_data >= 0)
+		result.messages.push_back(format("Restored %d imports delay-loaded by a previous run.",
+		                                 PElib::RestoreDelayLoad(dll, old_delay_data, &removed_fixups)));
+	// Relocation directory written by a previous run is removed too. Its fixups outside of
+	// removed sections are kept and written again with the new ones.
+	int old_relocs = dll.FindSection("relocs");
+	if (old_relocs >= 0
+		&& dll.SectionHeader(old_relocs).VirtualAddress
+		   != dll.PeHeader().OptionalHeader.DataDirectory[PElib::pe_directory_basereloc].VirtualAddress)
+	{
+		old_relocs = -1;
+	}
+	// Remove starting from the last one, so indexes stay valid. Relocations pointing into
+	// removed sections have to go too, new ones may be placed at the same RVAs.
+	vector<int> old_sections = { old_wrappers, old_exports, old_bound, old_trace, old_table,
+	                             old_hash, old_init, old_delay_code, old_delay_data, old_relocs };
+	std::sort(old_sections.rbegin(), old_sections.rend());
+	vector<RVA> kept_fixups;
+	for (const auto& block : PElib::ParseRelocations(dll))
+		for (ushort entry : block.entries)
+		{
+			if ((entry >> 12) != PElib::pe_rel_based_highlow)
+				continue;
+			uint fixup = block.page.val + (entry & 0xFFF);
+			bool removed = std::any_of(old_sections.begin(), old_sections.end(), [&](int index)
+			{
+				return index >= 0 && dll.SectionHeader(index).VirtualAddress <= fixup
+					&& fixup < dll.SectionHeader(index).VirtualAddress
+					           + dll.SectionHeader(index).VirtualSize;
+			});
+			if (removed)
+				removed_fixups.push_back(RVA{ fixup });
+			else if (old_relocs >= 0)
+				kept_fixups.push_back(RVA{ fixup });
+		}
+	for (int index : old_sections)
+		if (index >= 0)
+			dll.RemoveSection(index);
+	if (old_bound >= 0)
+		dll.SetDirectory(PElib::pe_directory_bound_import, RVA{ 0 }, 0);
+	if (old_relocs >= 0)
+		dll.SetDirectory(PElib::pe_directory_basereloc, RVA{ 0 }, 0);
+
+	// Forwarded exports can't be redirected (they don't point to any code in this DLL),
+	// but we can at least tell where they end up.
+	ModuleCache modules(options.search_path);
+	modules.Add(options.module_name, *view);
+	if (!options.search_path.empty())
+	{
+		for (const auto& exp : exports.Exports())
+		{
+			if (!exp.IsForwarded())
+				continue;
+			auto target = modules.Resolve(options.module_name, exp);
+			if (target.status == PElib::ResolveStatus::Ok)
+				result.messages.push_back(
+					format("Forwarded export #%d (%s) -> %s!%s at RVA %08x (%d hops)",
+					       exp.ordinal, exp.name.c_str(), target.module.c_str(),
+					       target.symbol.c_str(), target.rva.val, target.hops));
+			else
+				result.messages.push_back(
+					format("Forwarded export #%d (%s) -> %s: %s (at %s!%s)",
+					       exp.ordinal, exp.name.c_str(), exp.forwarder.c_str(),
+					       PElib::ResolveStatusName(target.status),
+					       target.module.c_str(), target.symbol.c_str()));
+		}
+	}
+
+	// Generate assembly code containing wrappers for exported functions
+	string source = redirect_source + "\n";
+
+	// Macro used for every export, empty for ones which aren't wrapped. Without rules all
+	// exports use `redirect`, exports selected for tracing use `trace_redirect` from
+	// trace.asm instead.
+	vector<string> macros(export_directory.NumberOfFunctions, "redirect");
+	if (!options.template_rules.empty())
+	{
+		auto rules = PElib::ParseTemplateRules(options.template_rules);
+		macros = PElib::SelectTemplates(rules, exports);
+		result.messages.push_back(format("Selected wrappers using %zd template rules.", rules.size()));
+	}
+	for (const auto& symbol : options.trace)
+	{
+		if (symbol.empty())
+			fatal_error("Can't trace an export with an empty name");
+		if (symbol == "*")
+		{
+			macros.assign(macros.size(), "trace_redirect");
+			continue;
+		}
+		const PElib::Export* exp = symbol[0] == '#'
+			? exports.FindByOrdinal(strtoul(symbol.c_str() + 1, nullptr, 10))
+			: exports.FindByName(symbol);
+		if (!exp)
+			fatal_error("Can't trace %s: no such export", symbol.c_str());
+		macros[exp->ordinal - export_directory.Base] = "trace_redirect";
+	}
+
+	// Wrappers are emitted in index order, unless there is a profile. Then the hottest
+	// ones go first, so they share cache lines and pages.
+	vector<uint> redirected;
+	for (uint i = 0; i < export_directory.NumberOfFunctions; i++)
+		if (!macros[i].empty() && view->IsAddrExecutable(originals[i]) && !exports[i].IsForwarded())
+			redirected.push_back(i);
+	if (!options.profile.empty())
+	{
+		auto profile = PElib::ParseProfile(options.profile, exports);
+		PElib::OrderByProfile(redirected, profile);
+		result.messages.push_back(
+			format("Ordered wrappers using profile (%zd exports listed).", profile.size()));
+	}
+	size_t traced_count = std::count_if(redirected.begin(), redirected.end(),
+	                                    [&](uint i) { return macros[i] == "trace_redirect"; });
+	if (traced_count)
+		source += options.trace_runtime + "\n";
+
+	// Find free RVA for new section. With detours, trampolines go first, as wrappers call
+	// them instead of the original functions.
+	auto free_rva = dll.NextFreeRVA();
+	vector<RVA> targets = originals;
+	std::unique_ptr<PElib::DetourBuilder> detours;
+	if (options.detour)
+	{
+		vector<RVA> functions;
+		for (uint i : redirected)
+			functions.push_back(originals[i]);
+		detours.reset(new PElib::DetourBuilder(dll, free_rva, functions));
+		for (const auto& failure : detours->Failures())
+			result.messages.push_back(format("Not detouring function at %08x: %s",
+			                                 failure.first, failure.second.c_str()));
+		for (uint i : redirected)
+			if (auto detour = detours->Find(originals[i]))
+				targets[i] = detour->trampoline;
+		detours->AddSection(dll);
+		free_rva = dll.NextFreeRVA();
+	}
+	// Pointer table for pointer_jmp.asm, initialized with the same targets. Wrappers
+	// reference it by VA, so they need relocations.
+	vector<RVA> new_fixups;
+	if (options.pointer_table)
+	{
+		vector<RVA> slot_targets(originals.size());
+		for (uint i : redirected)
+			slot_targets[i] = targets[i];
+		uint image_base = view->OptionalHeader().ImageBase;
+		string table = PElib::BuildPointerTable(free_rva, image_base, export_directory.Base,
+		                                        slot_targets, &new_fixups);
+		dll.AddSection("ptrtable",
+		               free_rva,
+		               align_up(table.size(), view->OptionalHeader().SectionAlignment),
+		               table,
+		               PElib::pe_scn_cnt_initialized_data | PElib::pe_scn_mem_read | PElib::pe_scn_mem_write);
+		source += format("__pointer_slots equ 0%08xh\n",
+		                 image_base + PElib::PointerTableSlots(free_rva).val);
+		free_rva = dll.NextFreeRVA();
+	}
+	// Records of load-time timing thunks, which go to the wrappers section.
+	vector<PElib::InitCallback> init_callbacks;
+	if (options.init_timing)
+	{
+		init_callbacks = PElib::FindInitCallbacks(dll);
+		dll.AddSection("inittime",
+		               free_rva,
+		               align_up(PElib::InitTimingSize(init_callbacks.size()),
+		                        view->OptionalHeader().SectionAlignment),
+		               PElib::BuildInitTiming(init_callbacks),
+		               PElib::pe_scn_cnt_initialized_data | PElib::pe_scn_mem_read | PElib::pe_scn_mem_write);
+		source += options.init_timing_runtime + "\n";
+		source += format("__init_records equ 0%08xh\n",
+		                 free_rva.val + PElib::InitTimingRecordsOffset(init_callbacks.size()));
+		for (size_t i = 0; i < init_callbacks.size(); i++)
+			source += format("init_thunk 0%08xh, %zd\n", init_callbacks[i].original.val, i);
+		free_rva = dll.NextFreeRVA();
+	}
+
+	// Generate wrapper macro call for every redirected function, passing function address
+	// and index as arguments.
+	for (uint i : redirected)
+		source += format("%s 0%08xh, %d\n", macros[i].c_str(), targets[i].val, i);
+	// Trace buffers go to a separate writable section. Space for metadata is reserved
+	// before it.
+	if (traced_count)
+	{
+		source += "__code_end:\n";
+		source += format("times %d db 0\n", PElib::WrappersMetadataSize(redirected.size()));
+		source += format("align 0%xh, db 0\n", view->OptionalHeader().SectionAlignment);
+		source += "__data_begin:\n";
+		source += "trace_data\n";
+	}
+	auto assembled = assemble(free_rva, source, scratch, options);
+	string compiled = assembled.code;
+	auto& labels = assembled.labels;
+	string trace_header;
+	if (traced_count)
+	{
+		trace_header = compiled.substr(labels["__data_begin"] - free_rva.val);
+		compiled.resize(labels["__code_end"] - free_rva.val);
+	}
+
+	// Change function pointers in export table so they point to generated wrappers. Exports
+	// which aren't wrapped keep (or get back) their original addresses.
+	vector<PElib::WrapperRecord> records;
+	vector<bool> wrapped(export_directory.NumberOfFunctions, false);
+	for (uint i : redirected)
+		wrapped[i] = true;
+	for (uint i = 0; i < export_directory.NumberOfFunctions; i++)
+	{
+		auto func_addr = originals[i];
+		if (!wrapped[i] && exports[i].rva.val == func_addr.val)
+			continue;
+		auto new_addr = wrapped[i] ? RVA{ labels[format("entry_%d", i)] } : func_addr;
+		if (old_exports < 0)
+			dll.Patch(RVA{ export_directory.AddressOfFunctions + i * (uint)sizeof(uint) },
+			          &new_addr.val, sizeof(new_addr.val));
+		exports.SetRVA(i, new_addr);
+		if (wrapped[i])
+			records.push_back(PElib::WrapperRecord{ i, func_addr.val, new_addr.val });
+	}
+
+	auto symbols = PElib::CollectThunkSymbols(labels, records, exports, init_callbacks,
+	                                          RVA{ free_rva.val + (uint)compiled.size() });
+	result.symbol_map = PElib::FormatThunkSymbolsText(symbols);
+	result.symbol_table = PElib::FormatThunkSymbolsBinary(symbols);
+
+	// Prepare new section and place compiled assembly in it, followed by metadata
+	// needed to process this DLL again.
+	compiled += PElib::BuildWrappersMetadata(records, RVA{ free_rva.val + (uint)compiled.size() });
+	dll.AddSection("wrappers",
+	               free_rva,
+				   align_up(compiled.size(), view->OptionalHeader().SectionAlignment),
+				   compiled,
+				   PElib::pe_scn_mem_read | PElib::pe_scn_mem_execute);
+	if (!trace_header.empty())
+	{
+		PElib::TraceHeader header;
+		if (trace_header.size() < sizeof(header))
+			fatal_error("Trace header not found in generated code");
+		memcpy(&header, trace_header.data(), sizeof(header));
+		uint buffer_size = sizeof(PElib::TraceBufferHeader)
+			+ header.records_per_buffer * header.record_size;
+		dll.AddSection("tracebuf",
+		               RVA{ labels["__data_begin"] },
+		               align_up(trace_header.size() + header.buffer_count * buffer_size,
+		                        view->OptionalHeader().SectionAlignment),
+		               trace_header,
+		               PElib::pe_scn_cnt_initialized_data | PElib::pe_scn_mem_read | PElib::pe_scn_mem_write);
+		result.messages.push_back(format("Tracing %zd exports.", traced_count));
+	}
+
+	if (options.init_timing)
+	{
+		vector<RVA> thunks;
+		for (size_t i = 0; i < init_callbacks.size(); i++)
+			thunks.push_back(RVA{ labels[PElib::InitThunkLabel(i)] });
+		PElib::PatchInitCallbacks(dll, init_callbacks, thunks);
+		result.messages.push_back(format("Timing %zd load-time callbacks.", init_callbacks.size()));
+	}
+
+	if (detours)
+	{
+		// Aliased exports share a function, it jumps to the first one's wrapper.
+		map<uint, uint> destinations;
+		for (const auto& record : records)
+			destinations.insert({ record.original_rva, record.entry_rva });
+		detours->PatchFunctions(dll, destinations);
+		const auto& moved = detours->MovedFixups();
+		const auto& copied = detours->TrampolineFixups();
+		removed_fixups.insert(removed_fixups.end(), moved.begin(), moved.end());
+		new_fixups.insert(new_fixups.end(), copied.begin(), copied.end());
+		result.messages.push_back(format("Detoured %zd functions.", detours->Detours().size()));
+	}
+	// Templates mark absolute addresses in generated code with `__fixup_*` labels.
+	for (const auto& label : labels)
+		if (label.first.compare(0, 8, "__fixup_") == 0)
+			new_fixups.push_back(RVA{ label.second });
+
+	// Unsorted name table breaks binary search done by GetProcAddress, so write a fixed one.
+	if (!exports.NamesSorted())
+		result.messages.push_back("Export names are not sorted, rebuilding export directory.");
+	if (rebuild_exports || !exports.NamesSorted())
+		PElib::WriteExportDirectory(dll, exports);
+	if (options.export_hash)
+		result.messages.push_back(format("Added perfect hash of %d export names.",
+		                                 PElib::WriteExportHash(dll, exports)));
+
+	if (options.bind)
+	{
+		for (const auto& binding : PElib::BindImports(dll, modules))
+			if (binding.bound)
+				result.messages.push_back(format("Bound %d imports from %s.", binding.imports,
+				                                 binding.module.c_str()));
+			else
+				result.messages.push_back(format("Not binding %s: %s", binding.module.c_str(),
+				                                 binding.reason.c_str()));
+	}
+
+	if (!options.delay_load.empty())
+	{
+		PElib::DelayLoadConversion conversion(dll, options.delay_load);
+		auto rva = dll.NextFreeRVA();
+		auto assembled = assemble(rva, options.delay_runtime + "\n" + conversion.Source(),
+		                          scratch, options);
+		conversion.Apply(rva, assembled.code, assembled.labels, &new_fixups);
+		result.messages.push_back(format("Converted %d imports to delay-load.",
+		                                 conversion.DelayedImports()));
+	}
+
+	// Relocations are rewritten only after all other sections were added, so that the next
+	// run finds them in the last section. Fixups kept from the old directory still have to
+	// be filtered, e.g. detours moved some of them.
+	std::sort(removed_fixups.begin(), removed_fixups.end(),
+	          [](RVA a, RVA b) { return a.val < b.val; });
+	for (RVA fixup : kept_fixups)
+		if (!std::binary_search(removed_fixups.begin(), removed_fixups.end(), fixup,
+		                        [](RVA a, RVA b) { return a.val < b.val; }))
+			new_fixups.push_back(fixup);
+	PElib::AddRelocations(dll, new_fixups, removed_fixups);
+
+	if (options.compact)
+	{
+		// Sections found by name when processing the DLL again are kept separate.
+		auto stats = PElib::Compact(dll, { "wrappers", "exports", "bound", "delayimp", "delaydat",
+		                                      "tracebuf", "detours", "ptrtable",
+		                                      "exphash", "inittime", "relocs" });
+		result.messages.push_back(format("Merged %d sections, trimmed %d bytes of raw data.",
+		                                 stats.merged_sections, stats.trimmed_bytes));
+	}
+
+	if (variant.output_path.empty())
+		result.image = dll.Build();
+	else
+		dll.Save(variant.output_path);
+}
+
+// Runs `f(result)`, turning errors into `result.error`.
+template<typename F> static Result run_safely(F f)
+{
+	Result result;
+	try
+	{
+		f(result);
+		result.ok = true;
+	}
+	catch (const exception& e)
+	{
+		result.error = e.what();
+		result.image.clear();
+	}
+	return result;
+}
+
+Result RewriteDll(const string& dll_data, const string& redirect_source, const Options& options)
+{
+	return run_safely([&](Result& result)
+	{
+		rewrite(ParsedDll(dll_data), Variant{ redirect_source, L"" }, "__tmp_generated", options,
+		        result);
+	});
+}
+
+vector<Result> RewriteVariants(const string& dll_data, const vector<Variant>& variants,
+                               const Options& options)
+{
+	std::unique_ptr<ParsedDll> input;
+	auto parsed = run_safely([&](Result&) { input.reset(new ParsedDll(dll_data)); });
+	if (!parsed.ok)
+		return vector<Result>(variants.size(), parsed);
+
+	vector<Result> results(variants.size());
+	vector<std::thread> threads;
+	for (size_t i = 0; i < variants.size(); i++)
+		threads.emplace_back([&, i]()
+		{
+			results[i] = run_safely([&](Result& result)
+			{
+				rewrite(*input, variants[i], format("__tmp_generated_%zd", i), options, result);
+			});
+		});
+	for (auto& thread : threads)
+		thread.join();
+	return results;
+}
+
+Result RebaseDll(const string& dll_data, unsigned int new_base)
+{
+	return run_safely([&](Result& result)
+	{
+		auto view = std::make_shared<const PEView>(dll_data);
+		PEEdit dll(view);
+		PElib::Rebase(dll, new_base);
+		result.image = dll.BuildInPlace();
+	});
+}
+
+}
@@ -0,0 +1,98 @@
+/*
+The whole DLL rewriting pipeline, usable as a library. Errors are reported in the returned
+`Result` instead of terminating the process.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace Rewriter
+{
+
+struct Options
+{
+	// File name of the DLL, used to resolve forwarders pointing back to it.
+	std::string module_name;
+	// Directories searched for DLLs targeted by export forwarders. Forwarders are
+	// reported only if it's not empty.
+	std::vector<std::wstring> search_path;
+	// Write a new export directory even if the original one could be patched in place.
+	bool rebuild_exports = false;
+	// Bind imports against DLLs from `search_path` (see Bind.h).
+	bool bind = false;
+	// Imported modules to convert to delay-load (see DelayLoad.h).
+	std::vector<std::string> delay_load;
+	// Contents of delay_load.asm, needed only if `delay_load` isn't empty.
+	std::string delay_runtime;
+	// Exports (names, "#ordinal" or "*" for all) wrapped with argument tracing thunks.
+	std::vector<std::string> trace;
+	// Contents of trace.asm, needed only if some export uses `trace_redirect`.
+	std::string trace_runtime;
+	// Also patch starts of exported functions with jumps to their wrappers, so internal
+	// calls are redirected too (see Detour.h).
+	bool detour = false;
+	// Add a writable table with a slot per export, initialized with original targets, for
+	// wrappers jumping through it (pointer_jmp.asm, see PointerTableFormat.h).
+	bool pointer_table = false;
+	// Redirect the entry point and TLS callbacks through thunks measuring them, with
+	// results in the "inittime" section (see InitTiming.h).
+	bool init_timing = false;
+	// Contents of init_timing.asm, needed only if `init_timing` is set.
+	std::string init_timing_runtime;
+	// Add a perfect hash of export names for fast lookups (see ExportHash.h).
+	bool export_hash = false;
+	// Merge compatible sections and trim zeros from raw data (see Compact.h).
+	bool compact = false;
+	// Pad generated code so that no branch crosses a multiple of this many bytes: 32
+	// (decoded uop cache lines, JCC erratum) or 64 (cache lines). 0 keeps the templates'
+	// own alignment. Applies to templates using `place_branch` (see short_jmp.asm).
+	unsigned int branch_boundary = 0;
+	// Run nasm in a private temporary directory, removed afterwards, instead of leaving
+	// __tmp_generated.* files in the current directory.
+	bool private_scratch = false;
+	// Contents of a profile file (see Profile.h), used to put hot wrappers first.
+	// Empty if there is no profile.
+	std::string profile;
+	// Contents of a rules file (see TemplateRules.h) choosing the macro for each export.
+	// Exports matching no rule keep their addresses. Empty: every export uses `redirect`.
+	std::string template_rules;
+};
+
+struct Result
+{
+	bool ok = false;
+	std::string error;                 // Set if !ok
+	std::string image;                 // Rewritten DLL
+	std::vector<std::string> messages; // Informational messages
+	// Symbols for generated thunks, in text and binary format (see ThunkSymbols.h).
+	std::string symbol_map;
+	std::string symbol_table;
+};
+
+// Redirects exports of DLL given in `dll_data` through wrappers generated from
+// `redirect_source`, which has to define the `redirect` nasm macro.
+Result RewriteDll(const std::string& dll_data, const std::string& redirect_source,
+                  const Options& options);
+
+struct Variant
+{
+	std::string redirect_source;
+	// The output is streamed there, reusing unchanged data of the input instead of building
+	// the whole image in memory. If empty, it's returned in `Result::image`.
+	std::wstring output_path;
+};
+
+// The same as RewriteDll(), but for several templates at once. The DLL and its exports
+// are parsed once, then variants are rewritten in parallel, each by its own thread.
+// Results are in the same order as `variants`.
+std::vector<Result> RewriteVariants(const std::string& dll_data,
+                                    const std::vector<Variant>& variants,
+                                    const Options& options);
+
+// Moves DLL to a new preferred ImageBase by applying its relocations (see Reloc.h).
+// Only the changed bytes are written, the file keeps its layout and any appended data.
+Result RebaseDll(const std::string& dll_data, unsigned int new_base);
+
+}
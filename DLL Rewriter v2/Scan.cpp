@@ -0,0 +1,271 @@
+#include "Scan.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "PEFormat.h"
+
+using std::ifstream;
+using std::ios;
+using std::max;
+using std::min;
+using std::string;
+using std::vector;
+using std::wstring;
+
+namespace PElib
+{
+
+// Exports are counted from AddressOfFunctions, read in chunks of this many entries.
+static const uint functions_chunk = 0x1000;
+
+class PositionedReader
+{
+	ifstream file;
+	ull size;
+
+public:
+	explicit PositionedReader(const wstring& path)
+		: file(native_path(path), ios::binary)
+	{
+		if (file.fail())
+			fatal_error("Cannot open file");
+		file.seekg(0, ios::end);
+		size = (ull)file.tellg();
+	}
+
+	ull Size() const { return size; }
+
+	void Read(ull offset, void* out, uint length)
+	{
+		if (offset > size || length > size - offset)
+			fatal_error("Truncated file (%u bytes at %llx)", length, offset);
+		file.seekg(offset);
+		file.read((char*)out, length);
+		if (file.fail())
+			fatal_error("Cannot read file");
+	}
+};
+
+static const PeSectionHeader* section_from_rva(const vector<PeSectionHeader>& sections,
+                                               uint rva, uint size)
+{
+	for (const auto& hdr : sections)
+		if (hdr.VirtualAddress <= rva && rva - hdr.VirtualAddress < hdr.SizeOfRawData
+			&& size <= hdr.SizeOfRawData - (rva - hdr.VirtualAddress))
+		{
+			return &hdr;
+		}
+	return nullptr;
+}
+
+static void scan(PositionedReader& file, ScanSummary& summary)
+{
+	PeDosHeader mz;
+	file.Read(0, &mz, sizeof(mz));
+	if (mz.e_magic != pe_dos_signature)
+		fatal_error("Invalid MZ signature");
+	if (mz.e_lfanew < (int32_t)sizeof(mz))
+		fatal_error("Bad value of field MZ.e_lfanew: %08x", mz.e_lfanew);
+
+	// The optional header is read as PE32. For PE32+ only the magic matters.
+	PeNtHeaders32 pe;
+	uint header_size = sizeof(pe.Signature) + sizeof(pe.FileHeader);
+	file.Read(mz.e_lfanew, &pe, header_size);
+	if (pe.Signature != pe_nt_signature)
+		fatal_error("Invalid PE signature");
+	summary.machine = pe.FileHeader.Machine;
+	summary.dll = (pe.FileHeader.Characteristics & pe_file_dll) != 0;
+	summary.sections = pe.FileHeader.NumberOfSections;
+	uint optional_size = pe.FileHeader.SizeOfOptionalHeader;
+	if (optional_size < sizeof(ushort))
+		fatal_error("Truncated optional header");
+	memset(&pe.OptionalHeader, 0, sizeof(pe.OptionalHeader));
+	file.Read(mz.e_lfanew + header_size, &pe.OptionalHeader,
+	          min(optional_size, (uint)sizeof(pe.OptionalHeader)));
+	summary.pe32 = pe.OptionalHeader.Magic == pe_optional32_magic;
+	if (!summary.pe32)
+		return;
+	summary.size_of_image = pe.OptionalHeader.SizeOfImage;
+
+	ull sections_pos = mz.e_lfanew + header_size + optional_size;
+	vector<PeSectionHeader> sections(summary.sections);
+	if (!sections.empty())
+		file.Read(sections_pos, sections.data(), sections.size() * sizeof(PeSectionHeader));
+	uint headers_end = pe.OptionalHeader.SizeOfImage;
+	for (const auto& hdr : sections)
+	{
+		headers_end = min(headers_end, (uint)hdr.VirtualAddress);
+		if (strncmp((const char*)hdr.Name, "wrappers", sizeof(hdr.Name)) == 0)
+			summary.rewritten = true;
+	}
+	// Headers are rebuilt with a full-size optional header when sections are added.
+	ull table_end = mz.e_lfanew + header_size + sizeof(pe.OptionalHeader)
+		+ sections.size() * sizeof(PeSectionHeader);
+	if (headers_end > table_end)
+		summary.free_section_slots =
+			(uint)((headers_end - table_end) / sizeof(PeSectionHeader));
+
+	if (pe.OptionalHeader.NumberOfRvaAndSizes <= pe_directory_export)
+		return;
+	const auto& exports_dir = pe.OptionalHeader.DataDirectory[pe_directory_export];
+	if (!exports_dir.VirtualAddress || !exports_dir.Size)
+		return;
+	PeExportDirectory directory;
+	auto hdr = section_from_rva(sections, exports_dir.VirtualAddress, sizeof(directory));
+	if (!hdr)
+		fatal_error("Export directory outside of section data");
+	file.Read(hdr->PointerToRawData + (exports_dir.VirtualAddress - hdr->VirtualAddress),
+	          &directory, sizeof(directory));
+	summary.named = directory.NumberOfNames;
+
+	// Only AddressOfFunctions is needed: forwarders point into the export directory.
+	hdr = section_from_rva(sections, directory.AddressOfFunctions,
+	                       directory.NumberOfFunctions * sizeof(uint));
+	if (!hdr || directory.NumberOfFunctions > 0x10000)
+		fatal_error("Invalid AddressOfFunctions");
+	ull functions_pos = hdr->PointerToRawData
+		+ (directory.AddressOfFunctions - hdr->VirtualAddress);
+	vector<uint> functions(min(directory.NumberOfFunctions, functions_chunk));
+	for (uint i = 0; i < directory.NumberOfFunctions; i += functions.size())
+	{
+		uint count = min(directory.NumberOfFunctions - i, (uint)functions.size());
+		file.Read(functions_pos + i * sizeof(uint), functions.data(), count * sizeof(uint));
+		for (uint j = 0; j < count; j++)
+		{
+			uint rva = functions[j];
+			summary.exports += rva != 0;
+			summary.forwarded += rva - exports_dir.VirtualAddress < exports_dir.Size;
+		}
+	}
+}
+
+ScanSummary ScanFile(const wstring& path)
+{
+	ScanSummary summary;
+	summary.path = path;
+	try
+	{
+		PositionedReader file(path);
+		scan(file, summary);
+	}
+	catch (const FatalError& e)
+	{
+		summary.error = e.what();
+	}
+	return summary;
+}
+
+vector<ScanSummary> ScanFiles(const vector<wstring>& paths, uint threads)
+{
+	// Scanning is mostly waiting for I/O, so use more threads than cores.
+	if (!threads)
+		threads = max(4u, 2 * std::thread::hardware_concurrency());
+	threads = min(threads, (uint)paths.size());
+
+	vector<ScanSummary> res(paths.size());
+	std::atomic<size_t> next(0);
+	auto worker = [&]()
+	{
+		for (size_t i = next++; i < paths.size(); i = next++)
+			res[i] = ScanFile(paths[i]);
+	};
+	vector<std::thread> pool;
+	for (uint i = 1; i < threads; i++)
+		pool.emplace_back(worker);
+	worker();
+	for (auto& thread : pool)
+		thread.join();
+	return res;
+}
+
+#ifdef _WIN32
+static bool is_directory(const wstring& path)
+{
+	DWORD attributes = GetFileAttributesW(path.c_str());
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+static void list_files(const wstring& dir, vector<wstring>& out)
+{
+	WIN32_FIND_DATAW data;
+	HANDLE handle = FindFirstFileW((dir + L"\\*").c_str(), &data);
+	if (handle == INVALID_HANDLE_VALUE)
+		return;
+	do
+	{
+		wstring name = data.cFileName;
+		if (name == L"." || name == L"..")
+			continue;
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			list_files(dir + L"\\" + name, out);
+		else
+			out.push_back(dir + L"\\" + name);
+	} while (FindNextFileW(handle, &data));
+	FindClose(handle);
+}
+#else
+static bool is_directory(const wstring& path)
+{
+	struct stat info;
+	return stat(native_path(path).c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+static void list_files(const wstring& dir, vector<wstring>& out)
+{
+	DIR* handle = opendir(native_path(dir).c_str());
+	if (!handle)
+		return;
+	while (dirent* entry = readdir(handle))
+	{
+		string name = entry->d_name;
+		if (name == "." || name == "..")
+			continue;
+		wstring path = dir + path_separator + wstring(name.begin(), name.end());
+		if (is_directory(path))
+			list_files(path, out);
+		else
+			out.push_back(path);
+	}
+	closedir(handle);
+}
+#endif
+
+vector<wstring> ExpandScanPaths(const vector<wstring>& paths)
+{
+	vector<wstring> res;
+	for (const auto& path : paths)
+	{
+		if (is_directory(path))
+			list_files(path, res);
+		else
+			res.push_back(path);
+	}
+	return res;
+}
+
+string FormatScanSummary(const ScanSummary& summary)
+{
+	string path(summary.path.begin(), summary.path.end());
+	if (!summary.error.empty())
+		return format("%s\terror: %s", path.c_str(), summary.error.c_str());
+	if (!summary.pe32)
+		return format("%s\tnot PE32\tmachine=%04x", path.c_str(), summary.machine);
+	return format("%s\t%s\tmachine=%04x\tsections=%u\tfree_slots=%u\timage=%x\texports=%u"
+	              "\tnamed=%u\tforwarded=%u%s",
+	              path.c_str(), summary.dll ? "dll" : "exe", summary.machine, summary.sections,
+	              summary.free_section_slots, summary.size_of_image, summary.exports,
+	              summary.named, summary.forwarded, summary.rewritten ? "\trewritten" : "");
+}
+
+}
@@ -0,0 +1,41 @@
+/*
+Quick triage of many files: reads only the headers, the section table and the export
+directory (with a few small positioned reads), instead of loading whole files like
+PEView does. Files are scanned in parallel.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+namespace PElib
+{
+
+struct ScanSummary
+{
+	std::wstring path;
+	std::string error;        // Empty if the file was parsed
+	bool pe32 = false;        // PE32 (not PE32+) image
+	bool dll = false;
+	ushort machine = 0;
+	uint sections = 0;
+	uint free_section_slots = 0; // Section headers which fit before the first section
+	uint size_of_image = 0;
+	uint exports = 0;         // Non-empty entries of AddressOfFunctions
+	uint named = 0;
+	uint forwarded = 0;
+	bool rewritten = false;   // Has "wrappers" section from a previous run
+};
+
+ScanSummary ScanFile(const std::wstring& path);
+// Results are in the same order as `paths`. `threads` == 0 picks a default.
+std::vector<ScanSummary> ScanFiles(const std::vector<std::wstring>& paths, uint threads);
+// Replaces directories with all files in them (recursively).
+std::vector<std::wstring> ExpandScanPaths(const std::vector<std::wstring>& paths);
+// One line, tab-separated.
+std::string FormatScanSummary(const ScanSummary& summary);
+
+}
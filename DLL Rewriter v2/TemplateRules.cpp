@@ -0,0 +1,139 @@
+#include "TemplateRules.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+
+using std::string;
+using std::vector;
+
+namespace PElib
+{
+
+static bool glob_match(const char* glob, const char* str)
+{
+	// Backtracks only to the last '*', which is enough for globs without character classes.
+	const char* star = nullptr;
+	const char* star_str = nullptr;
+	while (*str)
+	{
+		if (*glob == '*')
+		{
+			star = glob++;
+			star_str = str;
+		}
+		else if (*glob == '?' || *glob == *str)
+		{
+			glob++;
+			str++;
+		}
+		else if (star)
+		{
+			glob = star + 1;
+			str = ++star_str;
+		}
+		else
+			return false;
+	}
+	while (*glob == '*')
+		glob++;
+	return !*glob;
+}
+
+static bool is_identifier(const string& name)
+{
+	if (name.empty() || isdigit((unsigned char)name[0]))
+		return false;
+	for (char c : name)
+		if (!isalnum((unsigned char)c) && c != '_' && c != '.' && c != '$' && c != '?' && c != '@')
+			return false;
+	return true;
+}
+
+static uint parse_ordinal(const char* str, const char** end, uint line_no)
+{
+	char* num_end;
+	auto ordinal = strtoul(str, &num_end, 10);
+	if (num_end == str)
+		fatal_error("Invalid ordinal in line %d of template rules", line_no);
+	*end = num_end;
+	return (uint)ordinal;
+}
+
+vector<TemplateRule> ParseTemplateRules(const string& text)
+{
+	vector<TemplateRule> res;
+	std::istringstream stream(text);
+	string line;
+	uint line_no = 0;
+	while (std::getline(stream, line))
+	{
+		line_no++;
+		std::istringstream line_stream(line);
+		string pattern, macro, rest;
+		if (!(line_stream >> pattern) || pattern[0] == ';')
+			continue;
+		if (!(line_stream >> macro) || (line_stream >> rest && rest[0] != ';'))
+			fatal_error("Invalid template rule in line %d", line_no);
+
+		TemplateRule rule{ "", 0, 0, macro == "skip" ? "" : macro };
+		if (!rule.macro.empty() && !is_identifier(rule.macro))
+			fatal_error("Invalid macro name in line %d: %s", line_no, macro.c_str());
+		if (pattern[0] == '#')
+		{
+			const char* pos;
+			rule.first_ordinal = rule.last_ordinal = parse_ordinal(pattern.c_str() + 1, &pos, line_no);
+			if (*pos == '-')
+			{
+				pos++;
+				if (*pos == '#')
+					pos++;
+				rule.last_ordinal = parse_ordinal(pos, &pos, line_no);
+			}
+			if (*pos || rule.last_ordinal < rule.first_ordinal)
+				fatal_error("Invalid ordinal range in line %d: %s", line_no, pattern.c_str());
+		}
+		else
+			rule.glob = pattern;
+		res.push_back(rule);
+	}
+	return res;
+}
+
+vector<string> SelectTemplates(const vector<TemplateRule>& rules, const ExportIndex& exports)
+{
+	vector<string> res(exports.Directory().NumberOfFunctions);
+	// A glob naming any alias selects the export.
+	vector<vector<const char*>> names(res.size());
+	for (const auto& name : exports.Names())
+		if (name.index < names.size())
+			names[name.index].push_back(exports.NameString(name));
+	for (uint i = 0; i < res.size(); i++)
+	{
+		const auto& exp = exports[i];
+		for (const auto& rule : rules)
+		{
+			bool matches = rule.glob.empty()
+				? rule.first_ordinal <= exp.ordinal && exp.ordinal <= rule.last_ordinal
+				: std::any_of(names[i].begin(), names[i].end(),
+				              [&](const char* name) { return glob_match(rule.glob.c_str(), name); });
+			if (matches)
+			{
+				res[i] = rule.macro;
+				break;
+			}
+		}
+	}
+	return res;
+}
+
+bool RulesUseMacro(const vector<TemplateRule>& rules, const string& macro)
+{
+	for (const auto& rule : rules)
+		if (rule.macro == macro)
+			return true;
+	return false;
+}
+
+}
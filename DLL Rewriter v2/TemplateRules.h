@@ -0,0 +1,44 @@
+/*
+Rules choosing the wrapper macro for each export, so that only selected functions get
+instrumented and the rest keep their original addresses.
+
+Text format, one rule per line:
+	<name glob> <macro>
+	#<ordinal> <macro>
+	#<first>-<last> <macro>
+Globs use '*' (any string) and '?' (any character) and match only exports with names,
+any of them if an export has aliases.
+Ordinals are biased, as shown by dumpbin. <macro> is a nasm macro taking the same
+arguments as `redirect` (e.g. `trace_redirect` from trace.asm), or "skip". The first
+matching rule wins; exports matching no rule aren't wrapped. Empty lines and lines
+starting with ';' are ignored.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "Exports.h"
+
+namespace PElib
+{
+
+struct TemplateRule
+{
+	std::string glob;   // Empty for ordinal ranges
+	uint first_ordinal; // Inclusive, used if `glob` is empty
+	uint last_ordinal;
+	std::string macro;  // Empty for "skip"
+};
+
+std::vector<TemplateRule> ParseTemplateRules(const std::string& text);
+// Macro for every export, indexed like AddressOfFunctions. Empty for exports which
+// shouldn't be wrapped.
+std::vector<std::string> SelectTemplates(const std::vector<TemplateRule>& rules,
+                                         const ExportIndex& exports);
+// Whether any rule uses `macro`.
+bool RulesUseMacro(const std::vector<TemplateRule>& rules, const std::string& macro);
+
+}
@@ -0,0 +1,110 @@
+#include "ThunkSymbols.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace PElib
+{
+
+static const char symbols_magic[8] = { 'D', 'L', 'L', 'R', 'S', 'Y', 'M', 'S' };
+static const uint symbols_version = 1;
+
+vector<ThunkSymbol> CollectThunkSymbols(const map<string, uint>& labels,
+                                        const vector<WrapperRecord>& records,
+                                        const ExportIndex& exports,
+                                        const vector<InitCallback>& init_callbacks,
+                                        RVA code_end)
+{
+	// Start of every thunk: the lowest of labels ending with "_<index>".
+	map<uint, const WrapperRecord*> by_index;
+	for (const auto& record : records)
+		by_index[record.index] = &record;
+	map<uint, uint> starts;
+	for (const auto& label : labels)
+	{
+		auto underscore = label.first.find_last_of('_');
+		if (underscore == string::npos || underscore + 1 == label.first.size()
+			|| label.first.find('.') != string::npos)
+			continue;
+		char* end;
+		uint index = strtoul(label.first.c_str() + underscore + 1, &end, 10);
+		if (*end || !by_index.count(index))
+			continue;
+		auto it = starts.find(index);
+		if (it == starts.end() || label.second < it->second)
+			starts[index] = label.second;
+	}
+
+	vector<ThunkSymbol> res;
+	for (const auto& start : starts)
+	{
+		const auto& exp = exports[start.first];
+		ThunkSymbol symbol;
+		symbol.rva = RVA{ start.second };
+		symbol.size = 0;
+		symbol.name = "thunk:" + (exp.name.empty() ? format("#%d", exp.ordinal) : exp.name);
+		symbol.target = RVA{ by_index[start.first]->original_rva };
+		res.push_back(symbol);
+	}
+	uint tls_index = 0;
+	for (uint i = 0; i < init_callbacks.size(); i++)
+	{
+		auto label = labels.find(InitThunkLabel(i));
+		if (label == labels.end())
+			continue;
+		ThunkSymbol symbol;
+		symbol.rva = RVA{ label->second };
+		symbol.size = 0;
+		symbol.name = init_callbacks[i].kind == InitCallbackKind::EntryPoint
+			? "init:entry" : format("init:tls%d", tls_index++);
+		symbol.target = init_callbacks[i].original;
+		res.push_back(symbol);
+	}
+	std::sort(res.begin(), res.end(),
+	          [](const ThunkSymbol& a, const ThunkSymbol& b) { return a.rva.val < b.rva.val; });
+	for (size_t i = 0; i < res.size(); i++)
+	{
+		uint end = i + 1 < res.size() ? res[i + 1].rva.val : code_end.val;
+		res[i].size = end - res[i].rva.val;
+	}
+	return res;
+}
+
+string FormatThunkSymbolsText(const vector<ThunkSymbol>& symbols)
+{
+	string res;
+	for (const auto& symbol : symbols)
+		res += format("%08x %x %s %08x\n", symbol.rva.val, symbol.size, symbol.name.c_str(),
+		              symbol.target.val);
+	return res;
+}
+
+string FormatThunkSymbolsBinary(const vector<ThunkSymbol>& symbols)
+{
+	ThunkSymbolsHeader header;
+	memcpy(header.magic, symbols_magic, sizeof(symbols_magic));
+	header.version = symbols_version;
+	header.count = symbols.size();
+	header.strings_size = 0;
+	for (const auto& symbol : symbols)
+		header.strings_size += symbol.name.size() + 1;
+
+	string res((const char*)&header, sizeof(header));
+	uint name_offset = 0;
+	for (const auto& symbol : symbols)
+	{
+		ThunkSymbolRecord record = { symbol.rva.val, symbol.size, symbol.target.val, name_offset };
+		res.append((const char*)&record, sizeof(record));
+		name_offset += symbol.name.size() + 1;
+	}
+	for (const auto& symbol : symbols)
+		res.append(symbol.name.c_str(), symbol.name.size() + 1);
+	return res;
+}
+
+}
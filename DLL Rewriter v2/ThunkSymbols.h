@@ -0,0 +1,67 @@
+/*
+Symbols for generated wrappers, so profilers and stack walkers can attribute samples in
+the `wrappers` section. Every thunk covers the code from its first label (e.g.
+`longjmp_<index>`) up to the next thunk. Load-time timing thunks (see InitTiming.h) are
+named `init:entry` and `init:tls<index>` instead.
+
+Text format (perf-map style, hex numbers without prefix, one thunk per line):
+	<RVA> <size> <thunk:<export name or #ordinal> or init:...> <target RVA>
+
+Binary format (all integers are little-endian):
+	ThunkSymbolsHeader header;
+	ThunkSymbolRecord records[header.count];  // Sorted by RVA
+	char strings[header.strings_size];        // Null-terminated names
+*/
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "Exports.h"
+#include "InitTiming.h"
+#include "PElib.h"
+#include "WrappersMetadata.h"
+
+namespace PElib
+{
+
+#pragma pack(push, 1)
+struct ThunkSymbolsHeader
+{
+	char magic[8];     // "DLLRSYMS"
+	uint version;      // 1
+	uint count;
+	uint strings_size;
+};
+
+struct ThunkSymbolRecord
+{
+	uint rva;
+	uint size;
+	uint target_rva;
+	uint name_offset;  // Offset in strings
+};
+#pragma pack(pop)
+
+struct ThunkSymbol
+{
+	RVA rva;
+	uint size;
+	std::string name; // "thunk:<export name or #ordinal>", "init:entry" or "init:tls<index>"
+	RVA target;
+};
+
+// `labels` come from the nasm map file, `code_end` is the RVA where generated code ends.
+// `init_callbacks` have thunks only with --init-timing, otherwise pass an empty vector.
+std::vector<ThunkSymbol> CollectThunkSymbols(const std::map<std::string, uint>& labels,
+                                             const std::vector<WrapperRecord>& records,
+                                             const ExportIndex& exports,
+                                             const std::vector<InitCallback>& init_callbacks,
+                                             RVA code_end);
+std::string FormatThunkSymbolsText(const std::vector<ThunkSymbol>& symbols);
+std::string FormatThunkSymbolsBinary(const std::vector<ThunkSymbol>& symbols);
+
+}
@@ -0,0 +1,62 @@
+/*
+Layout of argument trace buffers written by `trace_redirect` wrappers (see trace.asm).
+Doesn't depend on Windows headers, so tools decoding memory dumps can use it on any
+platform. All integers are little-endian.
+
+The "tracebuf" section starts with `TraceHeader`, followed by `buffer_count` buffers:
+	TraceBufferHeader header;
+	TraceRecord records[records_per_buffer];
+
+A thread writes to buffer ((thread id >> 2) % buffer_count), so a buffer is usually owned
+by a single thread, but it's not required. Writers reserve records with `lock xadd` on
+`TraceBufferHeader::next` and never wait: record (next % records_per_buffer) is
+overwritten, so a full buffer keeps the newest records.
+
+While being written, a record has `sequence` == 0. It's set to (reserved number + 1)
+after all other fields. A record read concurrently is valid if it has the same non-zero
+sequence before and after copying it. In a memory dump, records with sequence == 0 are
+either unused or torn.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+namespace PElib
+{
+
+#pragma pack(push, 1)
+struct TraceHeader
+{
+	char magic[8];               // "DLLRTRCE"
+	uint32_t version;            // 1
+	uint32_t buffer_count;       // Power of 2
+	uint32_t records_per_buffer; // Power of 2
+	uint32_t record_size;        // sizeof(TraceRecord)
+	uint32_t args_count;         // Number of valid entries in TraceRecord::args
+	uint32_t reserved[9];
+};
+
+struct TraceBufferHeader
+{
+	uint32_t next;               // Number of records reserved so far
+	uint32_t reserved[15];
+};
+
+struct TraceRecord
+{
+	uint32_t sequence;           // Record number + 1, 0 if not (completely) written
+	uint32_t export_index;       // Index in AddressOfFunctions
+	uint32_t thread_id;
+	uint32_t return_address;     // VA the export returns to
+	uint64_t timestamp;          // rdtsc
+	uint32_t args[8];            // Stack arguments (whatever is on the stack, if fewer)
+	uint32_t reserved[2];
+};
+#pragma pack(pop)
+
+static_assert(sizeof(TraceHeader) == 64, "TraceHeader has to match trace.asm");
+static_assert(sizeof(TraceBufferHeader) == 64, "TraceBufferHeader has to match trace.asm");
+static_assert(sizeof(TraceRecord) == 64, "TraceRecord has to match trace.asm");
+
+}
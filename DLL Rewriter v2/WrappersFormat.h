@@ -0,0 +1,39 @@
+/*
+Metadata stored at the end of the `wrappers` section, which allows recognizing DLLs already
+processed by this tool and recovering original addresses of redirected exports. Doesn't
+depend on Windows headers, so code inspecting a loaded module (see HotPatch.h) can use it
+on any platform.
+
+Layout (at the end of raw data of the section, all integers are little-endian):
+	WrapperRecord records[count];
+	WrappersTrailer trailer;  // Last bytes of section raw data
+*/
+
+#pragma once
+
+#include <cstdint>
+
+namespace PElib
+{
+
+const char wrappers_magic[8] = { 'D', 'L', 'L', 'R', 'W', 'R', 'A', 'P' };
+const uint32_t wrappers_version = 1;
+
+#pragma pack(push, 1)
+struct WrapperRecord
+{
+	uint32_t index;        // Export index (in AddressOfFunctions)
+	uint32_t original_rva; // Original function address
+	uint32_t entry_rva;    // Address of `entry_<index>` label, put in the export table
+};
+
+struct WrappersTrailer
+{
+	char magic[8];         // "DLLRWRAP"
+	uint32_t version;      // 1
+	uint32_t count;        // Number of records
+	uint32_t records_rva;
+};
+#pragma pack(pop)
+
+}
@@ -0,0 +1,52 @@
+#include "WrappersMetadata.h"
+
+#include <cstring>
+
+using std::string;
+using std::vector;
+
+namespace PElib
+{
+
+uint WrappersMetadataSize(uint count)
+{
+	return count * sizeof(WrapperRecord) + sizeof(WrappersTrailer);
+}
+
+string BuildWrappersMetadata(const vector<WrapperRecord>& records, RVA rva)
+{
+	WrappersTrailer trailer;
+	memcpy(trailer.magic, wrappers_magic, sizeof(wrappers_magic));
+	trailer.version = wrappers_version;
+	trailer.count = records.size();
+	trailer.records_rva = rva.val;
+
+	string res((const char*)records.data(), records.size() * sizeof(WrapperRecord));
+	res.append((const char*)&trailer, sizeof(trailer));
+	return res;
+}
+
+bool ReadWrappersMetadata(const PEView& pe, uint index, vector<WrapperRecord>* records)
+{
+	const auto& header = pe.Sections().at(index);
+	if (header.SizeOfRawData < sizeof(WrappersTrailer))
+		return false;
+	WrappersTrailer trailer;
+	memcpy(&trailer, pe.SectionData(index) + header.SizeOfRawData - sizeof(trailer),
+	       sizeof(trailer));
+	if (memcmp(trailer.magic, wrappers_magic, sizeof(wrappers_magic)) != 0
+		|| trailer.version != wrappers_version)
+		return false;
+
+	auto records_size = (ull)trailer.count * sizeof(WrapperRecord);
+	if (trailer.records_rva < header.VirtualAddress
+		|| trailer.records_rva - header.VirtualAddress + records_size
+		   > header.SizeOfRawData - sizeof(trailer))
+		fatal_error("Corrupted wrappers metadata");
+	records->resize(trailer.count);
+	memcpy(records->data(), pe.Pointer(RVA{ trailer.records_rva }, (uint)records_size),
+	       (size_t)records_size);
+	return true;
+}
+
+}
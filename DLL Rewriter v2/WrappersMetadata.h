@@ -0,0 +1,24 @@
+/*
+Reading and writing of wrappers metadata (see WrappersFormat.h).
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "PEView.h"
+#include "WrappersFormat.h"
+
+namespace PElib
+{
+
+// Size of serialized metadata with `count` records.
+uint WrappersMetadataSize(uint count);
+// Serializes records, assuming they will start at `rva`.
+std::string BuildWrappersMetadata(const std::vector<WrapperRecord>& records, RVA rva);
+// Returns false if section `index` doesn't end with valid metadata.
+bool ReadWrappersMetadata(const PEView& pe, uint index, std::vector<WrapperRecord>* records);
+
+}
@@ -0,0 +1,209 @@
+#include "X86Decoder.h"
+
+namespace PElib
+{
+
+enum : uchar
+{
+	M = 0x01,      // ModR/M follows
+	I8 = 0x02,     // 8-bit immediate
+	IZ = 0x04,     // 16/32-bit immediate, depending on operand size
+	I16 = 0x08,    // 16-bit immediate
+	R8 = 0x10,     // 8-bit relative branch
+	RZ = 0x20,     // 16/32-bit relative branch
+	END = 0x40,    // Ends control flow
+	BAD = 0x80,    // Not supported (prefixes are handled separately)
+};
+
+static const uchar one_byte[256] =
+{
+	// 0x00
+	M, M, M, M, I8, IZ, 0, 0, M, M, M, M, I8, IZ, 0, BAD,
+	// 0x10
+	M, M, M, M, I8, IZ, 0, 0, M, M, M, M, I8, IZ, 0, 0,
+	// 0x20
+	M, M, M, M, I8, IZ, BAD, 0, M, M, M, M, I8, IZ, BAD, 0,
+	// 0x30
+	M, M, M, M, I8, IZ, BAD, 0, M, M, M, M, I8, IZ, BAD, 0,
+	// 0x40
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	// 0x50
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	// 0x60
+	0, 0, BAD, M, BAD, BAD, BAD, BAD, IZ, M | IZ, I8, M | I8, 0, 0, 0, 0,
+	// 0x70
+	R8, R8, R8, R8, R8, R8, R8, R8, R8, R8, R8, R8, R8, R8, R8, R8,
+	// 0x80
+	M | I8, M | IZ, M | I8, M | I8, M, M, M, M, M, M, M, M, M, M, M, M,
+	// 0x90
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, BAD, 0, 0, 0, 0, 0,
+	// 0xA0 (A0-A3 have a 32-bit address, handled in code)
+	0, 0, 0, 0, 0, 0, 0, 0, I8, IZ, 0, 0, 0, 0, 0, 0,
+	// 0xB0
+	I8, I8, I8, I8, I8, I8, I8, I8, IZ, IZ, IZ, IZ, IZ, IZ, IZ, IZ,
+	// 0xC0
+	M | I8, M | I8, I16 | END, END, BAD, BAD, M | I8, M | IZ,
+	I16 | I8, 0, I16 | END, END, END, I8, 0, END,
+	// 0xD0
+	M, M, M, M, I8, I8, 0, 0, M, M, M, M, M, M, M, M,
+	// 0xE0
+	R8, R8, R8, R8, I8, I8, I8, I8, RZ, RZ | END, BAD, R8 | END, 0, 0, 0, 0,
+	// 0xF0 (F6/F7 immediates depend on ModR/M, handled in code)
+	BAD, 0, BAD, BAD, END, 0, M, M, 0, 0, 0, 0, 0, 0, M, M,
+};
+
+static const uchar two_byte[256] =
+{
+	// 0x00
+	M, M, M, M, BAD, 0, 0, 0, 0, 0, BAD, END, BAD, M, 0, M | I8,
+	// 0x10
+	M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+	// 0x20
+	M, M, M, M, BAD, BAD, BAD, BAD, M, M, M, M, M, M, M, M,
+	// 0x30 (0F 38 and 0F 3A are three-byte opcodes, handled in code)
+	0, 0, 0, 0, 0, 0, BAD, 0, BAD, BAD, BAD, BAD, BAD, BAD, BAD, BAD,
+	// 0x40
+	M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+	// 0x50
+	M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+	// 0x60
+	M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+	// 0x70
+	M | I8, M | I8, M | I8, M | I8, M, M, M, 0, M, M, BAD, BAD, M, M, M, M,
+	// 0x80
+	RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ, RZ,
+	// 0x90
+	M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+	// 0xA0
+	0, 0, 0, M, M | I8, M, BAD, BAD, 0, 0, 0, M, M | I8, M, M, M,
+	// 0xB0
+	M, M, M, M, M, M, M, M, M, M, M | I8, M, M, M, M, M,
+	// 0xC0
+	M, M, M | I8, M, M | I8, M | I8, M | I8, M, 0, 0, 0, 0, 0, 0, 0, 0,
+	// 0xD0
+	M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+	// 0xE0
+	M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+	// 0xF0
+	M, M, M, M, M, M, M, M, M, M, M, M, M, M, M, M,
+};
+
+// Length of ModR/M byte with everything following it (SIB, displacement).
+static uint modrm_length(const uchar* code, size_t size, bool address16)
+{
+	if (!size)
+		return 0;
+	uint mod = code[0] >> 6;
+	uint rm = code[0] & 7;
+	if (mod == 3)
+		return 1;
+	if (address16)
+	{
+		if (mod == 0)
+			return rm == 6 ? 3 : 1;
+		return mod == 1 ? 2 : 3;
+	}
+	uint len = 1;
+	if (rm == 4)
+	{
+		if (size < 2)
+			return 0;
+		len++;
+		if (mod == 0 && (code[1] & 7) == 5)
+			return len + 4;
+	}
+	if (mod == 0)
+		return rm == 5 ? len + 4 : len;
+	return len + (mod == 1 ? 1 : 4);
+}
+
+X86Instruction DecodeX86(const uchar* code, size_t size)
+{
+	X86Instruction res = { 0, 0, false, 0, 0, false };
+	bool operand16 = false;
+	bool address16 = false;
+	uint pos = 0;
+
+	// Prefixes
+	for (;; pos++)
+	{
+		if (pos >= size || pos >= 15)
+			return res;
+		uchar byte = code[pos];
+		if (byte == 0x66)
+			operand16 = true;
+		else if (byte == 0x67)
+			address16 = true;
+		else if (!(byte == 0xF0 || byte == 0xF2 || byte == 0xF3 || byte == 0x26 || byte == 0x2E
+		           || byte == 0x36 || byte == 0x3E || byte == 0x64 || byte == 0x65))
+			break;
+	}
+
+	uchar opcode = code[pos];
+	uchar flags;
+	if (opcode == 0x0F)
+	{
+		if (++pos >= size)
+			return res;
+		opcode = code[pos];
+		res.two_byte = true;
+		if (opcode == 0x38 || opcode == 0x3A)
+		{
+			// Three-byte opcodes: all have ModR/M, 0F 3A ones also an 8-bit immediate.
+			flags = opcode == 0x3A ? M | I8 : M;
+			if (++pos >= size)
+				return res;
+		}
+		else
+			flags = two_byte[opcode];
+	}
+	else
+		flags = one_byte[opcode];
+	if (flags & BAD)
+		return res;
+	res.opcode_offset = pos;
+	pos++;
+
+	if (flags & M)
+	{
+		if (pos >= size)
+			return res;
+		uint reg = (code[pos] >> 3) & 7;
+		if (!res.two_byte)
+		{
+			// Group 3: only TEST has an immediate.
+			if (opcode == 0xF6 && reg <= 1)
+				flags |= I8;
+			if (opcode == 0xF7 && reg <= 1)
+				flags |= IZ;
+			// Group 5: indirect jmp (near and far)
+			if (opcode == 0xFF && (reg == 4 || reg == 5))
+				flags |= END;
+		}
+		uint len = modrm_length(code + pos, size - pos, address16);
+		if (!len)
+			return res;
+		pos += len;
+	}
+	if (!res.two_byte && opcode >= 0xA0 && opcode <= 0xA3)
+		pos += address16 ? 2 : 4;
+	if (flags & I16)
+		pos += 2;
+	if (flags & I8)
+		pos += 1;
+	if (flags & IZ)
+		pos += operand16 ? 2 : 4;
+	if (flags & (R8 | RZ))
+	{
+		res.rel_offset = pos;
+		res.rel_size = flags & R8 ? 1 : operand16 ? 2 : 4;
+		pos += res.rel_size;
+	}
+	res.ends_flow = (flags & END) != 0;
+	if (pos > size || pos > 15)
+		return res;
+	res.length = pos;
+	return res;
+}
+
+}
@@ -0,0 +1,29 @@
+/*
+Table-driven length decoder for 32-bit x86 code. It only finds instruction boundaries and
+relative branches (which have to be fixed when code is moved), it doesn't disassemble.
+VEX/EVEX-encoded and far-pointer instructions aren't supported.
+*/
+
+#pragma once
+
+#include <cstddef>
+
+#include "common.h"
+
+namespace PElib
+{
+
+struct X86Instruction
+{
+	uint length;        // 0 if the instruction couldn't be decoded
+	uint opcode_offset; // Offset of the (last) opcode byte
+	bool two_byte;      // Opcode is preceded by 0x0F
+	uint rel_offset;    // Offset of relative branch displacement, if rel_size != 0
+	uint rel_size;      // 1, 2 or 4 (0 if not a relative branch)
+	bool ends_flow;     // Control never continues to the next instruction (jmp, ret, ...)
+};
+
+// Decodes a single instruction from `size` available bytes.
+X86Instruction DecodeX86(const uchar* code, size_t size);
+
+}
@@ -0,0 +1,287 @@
+/*
+Per-call cost of generated wrappers compared with direct calls.
+
+Takes the code the rewriter would place in the `wrappers` section (nasm output and its map
+file, e.g. __tmp_generated.bin/.map left by a run) and maps it executable at its RVA
+relative to a common base, with a dummy `ret` function at each RVA targeted by a
+`longjmp_<index>` jump. Without arguments, wrappers for synthetic targets are generated
+with the short_jmp.asm layout instead.
+
+Each `entry_<index>` is then called in a tight loop (always the same export) and in
+a random order, and so are the targets directly and through pointer_jmp.asm style
+thunks (`jmp [slot]`, see PointerTableFormat.h). Reports ns/call and branch misses per
+call (if perf events are available). Wrapper code is position-independent, so the same
+bytes run in both 32- and 64-bit processes (indirect thunks are built for the current
+one):
+	g++ -O2 -std=c++14 call_bench.cpp -o call_bench
+	g++ -O2 -std=c++14 -m32 call_bench.cpp -o call_bench32
+	./call_bench [<code.bin> <code.map>] [calls]
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "perf_counter.h"
+
+using std::map;
+using std::string;
+using std::vector;
+
+typedef unsigned int uint;
+typedef unsigned long long ull;
+
+struct Wrapper
+{
+	uint entry_rva;
+	uint target_rva;
+};
+
+struct WrappersCode
+{
+	string code;
+	uint org;
+	vector<Wrapper> wrappers;
+};
+
+static string read_file(const char* path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (file.fail())
+	{
+		fprintf(stderr, "Cannot open file: %s\n", path);
+		exit(1);
+	}
+	return string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// Same format as parsed by parse_map_file() in common.cpp.
+static map<string, uint> read_map_file(const char* path)
+{
+	map<string, uint> res;
+	std::istringstream file(read_file(path));
+	bool after_marker = false;
+	string line;
+	while (std::getline(file, line))
+	{
+		if (line.find("__begin_marker") != string::npos)
+			after_marker = true;
+		if (!after_marker)
+			continue;
+		std::istringstream stream(line);
+		uint unused, rva;
+		string label;
+		if (stream >> std::hex >> unused >> rva >> label)
+			res[label] = rva;
+	}
+	return res;
+}
+
+// Target of `jmp rel32` or `jcc rel32` at `rva`.
+static bool jump_target(const WrappersCode& wc, uint rva, uint* target)
+{
+	uint off = rva - wc.org;
+	int32_t rel;
+	if (off + 5 <= wc.code.size() && (uint8_t)wc.code[off] == 0xE9)
+	{
+		memcpy(&rel, &wc.code[off + 1], sizeof(rel));
+		*target = rva + 5 + rel;
+		return true;
+	}
+	if (off + 6 <= wc.code.size() && (uint8_t)wc.code[off] == 0x0F
+		&& ((uint8_t)wc.code[off + 1] & 0xF0) == 0x80)
+	{
+		memcpy(&rel, &wc.code[off + 2], sizeof(rel));
+		*target = rva + 6 + rel;
+		return true;
+	}
+	return false;
+}
+
+static WrappersCode load_wrappers(const char* bin_path, const char* map_path)
+{
+	WrappersCode wc;
+	wc.code = read_file(bin_path);
+	auto labels = read_map_file(map_path);
+	if (!labels.count("__begin_marker"))
+	{
+		fprintf(stderr, "No __begin_marker in the map file\n");
+		exit(1);
+	}
+	wc.org = labels["__begin_marker"];
+	for (const auto& label : labels)
+	{
+		if (label.first.compare(0, 6, "entry_") != 0)
+			continue;
+		auto longjmp = labels.find("longjmp_" + label.first.substr(6));
+		Wrapper w;
+		w.entry_rva = label.second;
+		if (longjmp == labels.end() || !jump_target(wc, longjmp->second, &w.target_rva))
+		{
+			fprintf(stderr, "Can't find target of %s\n", label.first.c_str());
+			exit(1);
+		}
+		wc.wrappers.push_back(w);
+	}
+	return wc;
+}
+
+// Layout of `redirect` macro from short_jmp.asm.
+static WrappersCode synthesize_wrappers(uint count, uint org, uint targets_rva)
+{
+	WrappersCode wc;
+	wc.org = org;
+	for (uint i = 0; i < count; i++)
+	{
+		Wrapper w;
+		uint longjmp = org + (uint)wc.code.size();
+		w.target_rva = targets_rva + i * 64;
+		int32_t rel = (int32_t)(w.target_rva - (longjmp + 5));
+		wc.code += '\xE9';
+		wc.code.append((const char*)&rel, sizeof(rel));
+		wc.code.append(5, '\x90');
+		while (wc.code.size() % 16)
+			wc.code += '\x90';
+		w.entry_rva = org + (uint)wc.code.size();
+		wc.code += '\xEB';
+		wc.code += (char)(int8_t)(longjmp - (w.entry_rva + 2));
+		wc.wrappers.push_back(w);
+	}
+	return wc;
+}
+
+typedef void(*Func)();
+
+static void run(const char* name, const vector<Func>& funcs, const vector<uint>& calls)
+{
+	for (uint i = 0; i < calls.size() && i < 100000; i++) // Warm-up
+		funcs[calls[i]]();
+
+	PerfCounter branch_misses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+	branch_misses.Start();
+	auto start = std::chrono::steady_clock::now();
+	for (uint index : calls)
+		funcs[index]();
+	auto end = std::chrono::steady_clock::now();
+	ull misses = branch_misses.Stop();
+
+	double ns = std::chrono::duration<double, std::nano>(end - start).count() / calls.size();
+	printf("%-16s %10.2f ", name, ns);
+	if (branch_misses.Valid())
+		printf("%16.4f\n", (double)misses / calls.size());
+	else
+		printf("%16s\n", "n/a");
+}
+
+int main(int argc, char* argv[])
+{
+	WrappersCode wc;
+	int next_arg = 1;
+	if (argc >= 3)
+	{
+		wc = load_wrappers(argv[1], argv[2]);
+		next_arg = 3;
+	}
+	else
+		wc = synthesize_wrappers(1000, 0x100000, 0x1000);
+	uint calls_count = argc > next_arg ? (uint)atoi(argv[next_arg]) : 10000000;
+	if (wc.wrappers.empty())
+	{
+		fprintf(stderr, "No wrappers found\n");
+		return 1;
+	}
+
+	// Map everything from the lowest target up to the end of wrappers.
+	uint low = wc.org, high = wc.org + (uint)wc.code.size();
+	for (const auto& w : wc.wrappers)
+	{
+		low = std::min(low, w.target_rva);
+		high = std::max(high, w.target_rva + 1);
+	}
+	low &= ~0xFFFu;
+	size_t size = high - low;
+	auto mem = (uint8_t*)mmap(nullptr, size, PROT_READ | PROT_WRITE,
+	                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+	{
+		perror("mmap");
+		return 1;
+	}
+	memset(mem, 0xCC, size); // int3, so a bad jump crashes instead of sliding
+	memcpy(mem + wc.org - low, wc.code.data(), wc.code.size());
+	for (const auto& w : wc.wrappers)
+		mem[w.target_rva - low] = 0xC3; // ret
+	if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0)
+	{
+		perror("mprotect");
+		return 1;
+	}
+
+	uint count = wc.wrappers.size();
+	vector<Func> thunks(count), targets(count);
+	for (uint i = 0; i < count; i++)
+	{
+		thunks[i] = (Func)(mem + wc.wrappers[i].entry_rva - low);
+		targets[i] = (Func)(mem + wc.wrappers[i].target_rva - low);
+	}
+
+	// Indirect thunks: 8 bytes each, followed by a separate page-aligned slot array.
+	// `jmp [slot]` is absolute in 32-bit code and RIP-relative in 64-bit code.
+	size_t code_size = (count * 8 + 0xFFF) & ~(size_t)0xFFF;
+	size_t table_size = code_size + count * sizeof(void*);
+	auto table = (uint8_t*)mmap(nullptr, table_size, PROT_READ | PROT_WRITE,
+	                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (table == MAP_FAILED)
+	{
+		perror("mmap");
+		return 1;
+	}
+	memset(table, 0xCC, code_size);
+	auto slots = (Func*)(table + code_size);
+	vector<Func> indirect(count);
+	for (uint i = 0; i < count; i++)
+	{
+		uint8_t* thunk = table + i * 8;
+		int32_t disp = sizeof(void*) == 8 ? (int32_t)((uint8_t*)&slots[i] - (thunk + 6))
+		                                  : (int32_t)(uintptr_t)&slots[i];
+		thunk[0] = 0xFF;
+		thunk[1] = 0x25;
+		memcpy(thunk + 2, &disp, sizeof(disp));
+		slots[i] = targets[i];
+		indirect[i] = (Func)thunk;
+	}
+	if (mprotect(table, code_size, PROT_READ | PROT_EXEC) != 0)
+	{
+		perror("mprotect");
+		return 1;
+	}
+	vector<uint> tight(calls_count, 0);
+	vector<uint> random(calls_count);
+	std::mt19937 rng(1);
+	std::uniform_int_distribution<uint> dist(0, count - 1);
+	for (auto& call : random)
+		call = dist(rng);
+
+	printf("%zd-bit, %u wrappers, %u calls\n", sizeof(void*) * 8, count, calls_count);
+	printf("%-16s %10s %16s\n", "variant", "ns/call", "branch-miss/call");
+	run("direct, tight", targets, tight);
+	run("wrapper, tight", thunks, tight);
+	run("indirect, tight", indirect, tight);
+	run("direct, random", targets, random);
+	run("wrapper, random", thunks, random);
+	run("indirect, random", indirect, random);
+	munmap(table, table_size);
+	munmap(mem, size);
+	return 0;
+}
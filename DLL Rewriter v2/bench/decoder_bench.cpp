@@ -0,0 +1,83 @@
+/*
+Benchmark of the x86 length decoder (X86Decoder.h), on a prologue of every export, the
+way detour mode uses it. Prologues are synthesized from a mix of typical MSVC ones
+(hot-patchable `mov edi, edi`, frame setup, SEH frames, immediate stack adjustments).
+Portable:
+	g++ -O2 -std=c++14 -I.. decoder_bench.cpp ../X86Decoder.cpp -o decoder_bench
+	./decoder_bench [exports]
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "X86Decoder.h"
+
+using std::string;
+using std::vector;
+
+static const uint prologue_size = 32;
+
+static const vector<string> prologues =
+{
+	// mov edi, edi; push ebp; mov ebp, esp; sub esp, 10h
+	string("\x8B\xFF\x55\x8B\xEC\x83\xEC\x10", 8),
+	// push ebp; mov ebp, esp; push -1; push 12345678h; push offset handler
+	string("\x55\x8B\xEC\x6A\xFF\x68\x78\x56\x34\x12\x68\x00\x10\x00\x10", 15),
+	// sub esp, 108h; mov eax, [__security_cookie]; xor eax, esp
+	string("\x81\xEC\x08\x01\x00\x00\xA1\x00\x30\x00\x10\x33\xC4", 13),
+	// push esi; mov esi, [esp+8]; test esi, esi; je +10h
+	string("\x56\x8B\x74\x24\x08\x85\xF6\x74\x10", 9),
+	// mov eax, fs:[18h]; mov eax, [eax+30h]
+	string("\x64\xA1\x18\x00\x00\x00\x8B\x40\x30", 9),
+	// lea eax, [ecx+edx*4+100h]; cmp dword ptr [esp+4], 0
+	string("\x8D\x84\x91\x00\x01\x00\x00\x83\x7C\x24\x04\x00", 12),
+	// movzx eax, byte ptr [esp+4]; jmp dword ptr [eax*4+10001000h]
+	string("\x0F\xB6\x44\x24\x04\xFF\x24\x85\x00\x10\x00\x10", 12),
+};
+
+int main(int argc, char** argv)
+{
+	uint exports = argc > 1 ? strtoul(argv[1], nullptr, 0) : 100000;
+
+	// Functions are laid out one after another, padded with int3.
+	std::mt19937 rng(1);
+	string code(exports * prologue_size, '\xCC');
+	for (uint i = 0; i < exports; i++)
+	{
+		const auto& prologue = prologues[rng() % prologues.size()];
+		code.replace(i * prologue_size, prologue.size(), prologue);
+	}
+
+	auto data = (const uchar*)code.data();
+	uint decoded = 0;
+	uint moved_bytes = 0;
+	uint failed = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (uint i = 0; i < exports; i++)
+	{
+		uint pos = 0;
+		while (pos < 5)
+		{
+			auto insn = PElib::DecodeX86(data + i * prologue_size + pos, prologue_size - pos);
+			if (!insn.length)
+			{
+				failed++;
+				break;
+			}
+			pos += insn.length;
+			decoded++;
+		}
+		moved_bytes += pos;
+	}
+	auto elapsed = std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+
+	printf("%u prologues, %u instructions (%u failed) in %.3f ms (%.1f ns/instruction)\n",
+	       exports, decoded, failed, elapsed, elapsed * 1e6 / (decoded ? decoded : 1));
+	printf("%.2f bytes moved per function\n", (double)moved_bytes / exports);
+	return 0;
+}
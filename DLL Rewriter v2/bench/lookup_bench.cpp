@@ -0,0 +1,85 @@
+/*
+Export lookup by name: binary search over a sorted name table (what GetProcAddress does)
+compared with the perfect hash from ExportHash.h. Names are synthetic, with long common
+prefixes, as in big C++ and COM DLLs. Portable:
+	g++ -O2 -std=c++14 -I.. lookup_bench.cpp ../ExportHashBuilder.cpp -o lookup_bench
+	./lookup_bench [exports] [lookups]
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ExportHash.h"
+#include "ExportHashBuilder.h"
+
+using std::string;
+using std::vector;
+
+static const char* prefixes[] =
+{
+	"?Get", "?Set", "Nt", "Rtl", "CreateInstance", "DllRegister", "??0CWindowImpl@@",
+};
+
+int main(int argc, char** argv)
+{
+	uint32_t count = argc > 1 ? strtoul(argv[1], nullptr, 0) : 20000;
+	uint32_t lookups = argc > 2 ? strtoul(argv[2], nullptr, 0) : 1000000;
+
+	std::mt19937 rng(1);
+	vector<string> names;
+	for (uint32_t i = 0; i < count; i++)
+		names.push_back(string(prefixes[rng() % 7]) + "Object" + std::to_string(rng() % 1000)
+		                + "_" + std::to_string(i) + "@@QAEXXZ");
+	std::sort(names.begin(), names.end());
+	vector<const char*> name_table;
+	vector<PElib::ExportHashKey> keys;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		name_table.push_back(names[i].c_str());
+		keys.push_back(PElib::ExportHashKey{ names[i], i + 1, 0x1000 + i * 16 });
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	string section = PElib::BuildExportHash(keys);
+	double build_ms = std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+	PElib::ExportHashTable table(section.data(), section.size());
+	if (!table.Valid())
+	{
+		fprintf(stderr, "Can't build the hash table\n");
+		return 1;
+	}
+
+	vector<uint32_t> queries(lookups);
+	for (auto& query : queries)
+		query = rng() % count;
+
+	uint32_t found = 0;
+	start = std::chrono::steady_clock::now();
+	for (uint32_t query : queries)
+	{
+		const char* name = names[query].c_str();
+		auto it = std::lower_bound(name_table.begin(), name_table.end(), name,
+		                           [](const char* a, const char* b) { return strcmp(a, b) < 0; });
+		found += it != name_table.end() && strcmp(*it, name) == 0;
+	}
+	double search_ns = std::chrono::duration<double, std::nano>(
+		std::chrono::steady_clock::now() - start).count() / lookups;
+
+	start = std::chrono::steady_clock::now();
+	for (uint32_t query : queries)
+		found += table.Find(names[query].c_str(), names[query].size()) != nullptr;
+	double hash_ns = std::chrono::duration<double, std::nano>(
+		std::chrono::steady_clock::now() - start).count() / lookups;
+
+	printf("%u exports, table %zu bytes, built in %.2f ms\n", count, section.size(), build_ms);
+	printf("binary search: %8.1f ns/lookup\n", search_ns);
+	printf("perfect hash:  %8.1f ns/lookup\n", hash_ns);
+	return found == 2 * lookups ? 0 : 1;
+}
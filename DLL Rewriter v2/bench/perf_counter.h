@@ -0,0 +1,57 @@
+/*
+Minimal wrapper for a single Linux perf event counting the current thread in user mode.
+Counters may be unavailable (e.g. in VMs or with restrictive perf_event_paranoid), in which
+case Valid() returns false and Stop() returns 0.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+class PerfCounter
+{
+	int fd;
+
+public:
+	PerfCounter(uint32_t type, uint64_t config)
+	{
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+	PerfCounter(const PerfCounter&) = delete;
+	PerfCounter& operator=(const PerfCounter&) = delete;
+	~PerfCounter() { if (fd >= 0) close(fd); }
+
+	bool Valid() const { return fd >= 0; }
+	void Start() { if (fd >= 0) { ioctl(fd, PERF_EVENT_IOC_RESET, 0); ioctl(fd, PERF_EVENT_IOC_ENABLE, 0); } }
+	unsigned long long Stop()
+	{
+		unsigned long long val = 0;
+		if (fd >= 0)
+		{
+			ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+			if (read(fd, &val, sizeof(val)) != sizeof(val))
+				val = 0;
+		}
+		return val;
+	}
+};
+
+// Config value for PERF_TYPE_HW_CACHE read events.
+inline uint64_t perf_cache_event(uint64_t cache, uint64_t result)
+{
+	return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);
+}
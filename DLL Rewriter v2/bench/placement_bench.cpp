@@ -0,0 +1,196 @@
+/*
+Benchmark of branch placement policies (--branch-boundary, `place_branch` macro).
+
+Builds wrappers with the same layout as `trace_redirect` from trace.asm (the longest
+standard template, whose branches may cross 32-byte boundaries) in executable memory,
+padded like `place_branch` would do for each policy, and calls all of them in a loop.
+"split" places every branch across a 32-byte boundary on purpose, as the worst case.
+On cores with the JCC erratum microcode, such branches can't be cached in the decoded
+uop cache, so the difference is the largest there.
+
+Linux/x86 only. Reports time per call, padding added and the number of branches
+crossing (or ending at) 32- and 64-byte boundaries:
+	g++ -O2 -std=c++14 placement_bench.cpp -o placement_bench
+	./placement_bench [exports] [rounds]
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "perf_counter.h"
+
+using std::vector;
+
+typedef unsigned int uint;
+typedef unsigned long long ull;
+
+struct Layout
+{
+	vector<uint> entries;
+	uint padding = 0;
+	uint split32 = 0; // Branches crossing or ending at a 32-byte boundary
+	uint split64 = 0; // Branches crossing a 64-byte boundary
+};
+
+class Emitter
+{
+	uint8_t* code;
+	uint pos;
+	uint boundary;
+	bool force_split;
+
+public:
+	Layout layout;
+
+	Emitter(uint8_t* code, uint pos, uint boundary, bool force_split)
+		: code(code), pos(pos), boundary(boundary), force_split(force_split) {}
+
+	uint Pos() const { return pos; }
+
+	void Nops(uint count)
+	{
+		memset(code + pos, 0x90, count);
+		pos += count;
+		layout.padding += count;
+	}
+
+	// Same rule as `place_branch` from Rewriter.cpp.
+	void Place(uint size)
+	{
+		if (force_split)
+		{
+			// Start 2 bytes before the next 32-byte boundary.
+			Nops((30 - pos % 32 + 32) % 32);
+			return;
+		}
+		if (!boundary)
+			return;
+		uint ends_count = boundary == 32 ? 1 : 0;
+		uint off = pos % boundary;
+		Nops((off + size - 1 + ends_count) / boundary * (boundary - off));
+	}
+
+	void Branch(const uint8_t* bytes, uint size)
+	{
+		uint last = pos + size - 1;
+		if (pos / 32 != last / 32 || (last + 1) % 32 == 0)
+			layout.split32++;
+		if (pos / 64 != last / 64)
+			layout.split64++;
+		memcpy(code + pos, bytes, size);
+		pos += size;
+	}
+
+	void Bytes(const uint8_t* bytes, uint size)
+	{
+		memcpy(code + pos, bytes, size);
+		pos += size;
+	}
+
+	void Rel32(uint8_t opcode, uint target)
+	{
+		uint8_t bytes[5] = { opcode };
+		int32_t rel = (int32_t)(target - (pos + 5));
+		memcpy(bytes + 1, &rel, sizeof(rel));
+		Branch(bytes, 5);
+	}
+};
+
+// Layout matches `trace_redirect` macro from trace.asm, with 64-bit push.
+static Layout emit_wrappers(uint8_t* code, uint code_base, uint record, uint target,
+                            uint exports, uint boundary, bool force_split)
+{
+	Emitter out(code, code_base, boundary, force_split);
+	out.layout.entries.resize(exports);
+	for (uint i = 0; i < exports; i++)
+	{
+		out.Place(5);
+		uint longjmp = out.Pos();
+		out.Rel32(0xE9, target); // jmp target
+		while (out.Pos() % 16) // align 16, nop
+			out.Nops(1);
+		out.layout.entries[i] = out.Pos();
+		uint8_t push[5] = { 0x68 }; // push imm32
+		memcpy(push + 1, &i, sizeof(i));
+		out.Bytes(push, sizeof(push));
+		out.Place(5);
+		out.Rel32(0xE8, record); // call record
+		out.Place(2);
+		int rel = (int)longjmp - (int)(out.Pos() + 2);
+		if (rel < -128)
+		{
+			fprintf(stderr, "Short jump out of range\n");
+			exit(1);
+		}
+		uint8_t jmp[2] = { 0xEB, (uint8_t)rel }; // jmp short longjmp
+		out.Branch(jmp, sizeof(jmp));
+	}
+	return out.layout;
+}
+
+int main(int argc, char* argv[])
+{
+	uint exports = argc > 1 ? (uint)atoi(argv[1]) : 128;
+	uint rounds = argc > 2 ? (uint)atoi(argv[2]) : 200000;
+
+	const uint record = 0, target = 16, code_base = 4096;
+	size_t map_size = code_base + exports * 256;
+	auto mem = (uint8_t*)mmap(nullptr, map_size, PROT_READ | PROT_WRITE | PROT_EXEC,
+	                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+	{
+		perror("mmap");
+		return 1;
+	}
+	const uint8_t ret8[] = { 0xC2, 0x08, 0x00 }; // ret 8, pops the export index
+	memcpy(mem + record, ret8, sizeof(ret8));
+	mem[target] = 0xC3; // ret
+
+	printf("%u exports, %u rounds\n", exports, rounds);
+	printf("%-6s %10s %10s %10s %10s %14s\n",
+	       "policy", "ns/call", "padding", "split32", "split64", "cycles/call");
+	const struct { const char* name; uint boundary; bool force_split; } policies[] = {
+		{ "split", 0, true },
+		{ "none", 0, false },
+		{ "32", 32, false },
+		{ "64", 64, false },
+	};
+	for (const auto& policy : policies)
+	{
+		memset(mem + code_base, 0xCC, map_size - code_base);
+		auto layout = emit_wrappers(mem, code_base, record, target, exports,
+		                            policy.boundary, policy.force_split);
+		vector<void(*)()> funcs(exports);
+		for (uint i = 0; i < exports; i++)
+			funcs[i] = (void(*)())(mem + layout.entries[i]);
+		for (uint r = 0; r < rounds / 10 + 1; r++) // Warm-up
+			for (auto func : funcs)
+				func();
+
+		PerfCounter cycles(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+		cycles.Start();
+		auto start = std::chrono::steady_clock::now();
+		for (uint r = 0; r < rounds; r++)
+			for (auto func : funcs)
+				func();
+		auto end = std::chrono::steady_clock::now();
+		ull cycles_count = cycles.Stop();
+
+		double calls = (double)rounds * exports;
+		double ns = std::chrono::duration<double, std::nano>(end - start).count() / calls;
+		printf("%-6s %10.2f %10u %10u %10u ", policy.name, ns, layout.padding,
+		       layout.split32, layout.split64);
+		if (cycles.Valid())
+			printf("%14.2f\n", cycles_count / calls);
+		else
+			printf("%14s\n", "n/a");
+	}
+	munmap(mem, map_size);
+	return 0;
+}
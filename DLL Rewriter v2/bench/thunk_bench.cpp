@@ -0,0 +1,158 @@
+/*
+Benchmark of wrapper layout: export index order vs profile order (see Profile.h).
+
+Builds wrappers with the same layout as short_jmp.asm in executable memory, next to dummy
+target functions, and calls them with a skewed (Zipf-like) mix of exports. Hot exports are
+scattered over the whole index range, as in real DLLs. Profile order uses call counts
+from a separate training run of the same mix.
+
+Linux/x86 only. Reports time per call and, if perf events are available, iTLB and L1i
+misses:
+	g++ -O2 -std=c++14 thunk_bench.cpp -o thunk_bench
+	./thunk_bench [exports] [calls]
+
+Measured on a single-vCPU Xeon VM without perf events (default arguments, 6 runs),
+ns/call index vs profile: 51.1/44.5, 45.1/43.9, 38.8/38.1, 38.3/39.6, 37.9/40.0,
+38.7/38.2; with 4096 exports 25.4/25.2. The differences are within run-to-run noise
+there, so the profile layout isn't shown to help on that machine. It should be
+measured on bare metal, with iTLB/L1i counters, before relying on it.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "perf_counter.h"
+
+using std::vector;
+
+typedef unsigned int uint;
+typedef unsigned long long ull;
+
+static const uint target_stride = 64; // Distance between dummy target functions
+
+// Emits wrappers in given order into `code`, returns entry offsets indexed by export.
+// Layout matches `redirect` macro from short_jmp.asm.
+static vector<uint> emit_wrappers(uint8_t* code, uint code_base, uint targets_base,
+                                  const vector<uint>& order)
+{
+	vector<uint> entries(order.size());
+	uint pos = code_base;
+	for (uint index : order)
+	{
+		uint longjmp = pos;
+		int32_t rel = (int32_t)(targets_base + index * target_stride - (longjmp + 5));
+		code[pos++] = 0xE9; // jmp rel32
+		memcpy(code + pos, &rel, sizeof(rel));
+		pos += sizeof(rel);
+		for (int i = 0; i < 5; i++) // times 5 nop
+			code[pos++] = 0x90;
+		while (pos % 16) // align 16, nop
+			code[pos++] = 0x90;
+		entries[index] = pos;
+		code[pos++] = 0xEB; // jmp short longjmp
+		code[pos] = (uint8_t)(longjmp - (pos + 1));
+		pos++;
+	}
+	return entries;
+}
+
+static vector<uint> make_calls(uint exports, uint count, const vector<uint>& rank_to_index,
+                               uint seed)
+{
+	// Zipf(1) distribution over ranks.
+	vector<double> weights(exports);
+	for (uint i = 0; i < exports; i++)
+		weights[i] = 1.0 / (i + 1);
+	std::discrete_distribution<uint> dist(weights.begin(), weights.end());
+	std::mt19937 rng(seed);
+	vector<uint> calls(count);
+	for (auto& call : calls)
+		call = rank_to_index[dist(rng)];
+	return calls;
+}
+
+int main(int argc, char* argv[])
+{
+	uint exports = argc > 1 ? (uint)atoi(argv[1]) : 20000;
+	uint calls_count = argc > 2 ? (uint)atoi(argv[2]) : 20000000;
+
+	// Hot exports are scattered randomly over the index range.
+	vector<uint> rank_to_index(exports);
+	std::iota(rank_to_index.begin(), rank_to_index.end(), 0);
+	std::shuffle(rank_to_index.begin(), rank_to_index.end(), std::mt19937(1));
+
+	// Training run: gather a profile.
+	vector<ull> profile(exports);
+	for (uint index : make_calls(exports, calls_count / 10, rank_to_index, 2))
+		profile[index]++;
+	auto calls = make_calls(exports, calls_count, rank_to_index, 3);
+
+	vector<uint> index_order(exports);
+	std::iota(index_order.begin(), index_order.end(), 0);
+	vector<uint> profile_order = index_order;
+	std::stable_sort(profile_order.begin(), profile_order.end(),
+	                 [&](uint a, uint b) { return profile[a] > profile[b]; });
+
+	uint targets_size = exports * target_stride;
+	uint code_size = exports * 32;
+	size_t map_size = targets_size + code_size;
+	auto mem = (uint8_t*)mmap(nullptr, map_size, PROT_READ | PROT_WRITE | PROT_EXEC,
+	                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+	{
+		perror("mmap");
+		return 1;
+	}
+	memset(mem, 0xC3, targets_size); // ret
+
+	printf("%u exports, %u calls\n", exports, calls_count);
+	printf("%-8s %10s %14s %14s\n", "order", "ns/call", "iTLB misses", "L1i misses");
+	const struct { const char* name; const vector<uint>* order; } variants[] = {
+		{ "index", &index_order },
+		{ "profile", &profile_order },
+	};
+	for (const auto& variant : variants)
+	{
+		auto entries = emit_wrappers(mem, targets_size, 0, *variant.order);
+		vector<void(*)()> funcs(exports);
+		for (uint i = 0; i < exports; i++)
+			funcs[i] = (void(*)())(mem + entries[i]);
+		for (uint i = 0; i < std::min(calls_count, 100000u); i++) // Warm-up
+			funcs[calls[i]]();
+
+		PerfCounter itlb(PERF_TYPE_HW_CACHE,
+		                 perf_cache_event(PERF_COUNT_HW_CACHE_ITLB, PERF_COUNT_HW_CACHE_RESULT_MISS));
+		PerfCounter l1i(PERF_TYPE_HW_CACHE,
+		                perf_cache_event(PERF_COUNT_HW_CACHE_L1I, PERF_COUNT_HW_CACHE_RESULT_MISS));
+		itlb.Start();
+		l1i.Start();
+		auto start = std::chrono::steady_clock::now();
+		for (uint index : calls)
+			funcs[index]();
+		auto end = std::chrono::steady_clock::now();
+		ull itlb_misses = itlb.Stop();
+		ull l1i_misses = l1i.Stop();
+
+		double ns = std::chrono::duration<double, std::nano>(end - start).count() / calls.size();
+		printf("%-8s %10.2f ", variant.name, ns);
+		if (itlb.Valid())
+			printf("%14llu ", itlb_misses);
+		else
+			printf("%14s ", "n/a");
+		if (l1i.Valid())
+			printf("%14llu\n", l1i_misses);
+		else
+			printf("%14s\n", "n/a");
+	}
+	munmap(mem, map_size);
+	return 0;
+}
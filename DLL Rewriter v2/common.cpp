@@ -6,21 +6,16 @@
 #include <fstream>
 #include <limits>
 #include <map>
+#include <memory>
 #include <sstream>
 #include <string>
 
-#include <conio.h> // for _getch()
-#include <Windows.h>
-
-#ifdef max // garbage from Windows.h
-#undef max
-#endif
-
 using std::hex;
 using std::ifstream;
 using std::ios;
 using std::map;
 using std::numeric_limits;
+using std::ofstream;
 using std::string;
 using std::wstring;
 
@@ -28,17 +23,13 @@ using std::wstring;
 {
 	va_list va;
 	va_start(va, fmt);
-	fprintf(stderr, "Error: ");
-	vfprintf(stderr, fmt, va);
-	fprintf(stderr, "\n");
+	auto size = vsnprintf(nullptr, 0, fmt, va) + 1; // +1: Space for '\0'
 	va_end(va);
-
-#if defined(_MSC_VER) && defined(_DEBUG)
-	puts("[Press any key]");
-	_getch();
-#endif
-
-	exit(1);
+	std::unique_ptr<char[]> buf(new char[size]);
+	va_start(va, fmt);
+	vsnprintf(buf.get(), size, fmt, va);
+	va_end(va);
+	throw FatalError(buf.get());
 }
 
 string read_whole_file(const string& path)
@@ -48,7 +39,7 @@ string read_whole_file(const string& path)
 
 string read_whole_file(const wstring& path)
 {
-	ifstream file(path, ios::binary);
+	ifstream file(native_path(path), ios::binary);
 	if (file.fail())
 		fatal_error("Cannot open file: %ls", path.c_str());
 	file.seekg(0, ios::end);
@@ -56,7 +47,7 @@ string read_whole_file(const wstring& path)
 	file.seekg(0);
 
 	string buffer;
-	if (size > numeric_limits<size_t>::max())
+	if ((ull)size > numeric_limits<size_t>::max())
 		// We have to check this, otherwise buffer.resize() would trim
 		// the value, but file.read wouldn't.
 		fatal_error("File too big to load to memory: %ls", path.c_str());
@@ -67,6 +58,17 @@ string read_whole_file(const wstring& path)
 	return buffer;
 }
 
+void write_whole_file(const wstring& path, const string& data)
+{
+	ofstream file(native_path(path), ios::binary);
+	if (file.fail())
+		fatal_error("Cannot open file: %ls", path.c_str());
+	file.write(data.data(), data.size());
+	file.close();
+	if (file.fail())
+		fatal_error("Cannot write file: %ls", path.c_str());
+}
+
 map<string, uint> parse_map_file(string map_file_path)
 {
 	return parse_map_file(wstring(map_file_path.begin(), map_file_path.end()));
@@ -75,7 +77,7 @@ map<string, uint> parse_map_file(string map_file_path)
 map<string, uint> parse_map_file(wstring map_file_path)
 {
 	map<string, uint> res;
-	ifstream file(map_file_path);
+	ifstream file(native_path(map_file_path));
 	bool after_marker = false;
 
 	string line;
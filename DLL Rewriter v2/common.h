@@ -1,7 +1,9 @@
 #pragma once
 
+#include <cstdio>
 #include <map>
 #include <memory>
+#include <stdexcept>
 #include <string>
 
 typedef unsigned char uchar;
@@ -23,9 +25,37 @@ template<typename T1, typename T2> auto align_up(T1 val, T2 mod) -> decltype(T1(
 	return val + (mod - val % mod) % mod;
 }
 
-void fatal_error(const char* fmt, ...);
+// Thrown by `fatal_error`. Callers embedding the rewriter can catch it instead of
+// having the whole process terminated.
+class FatalError : public std::runtime_error
+{
+public:
+	explicit FatalError(const std::string& message) : std::runtime_error(message) {}
+};
+
+[[noreturn]] void fatal_error(const char* fmt, ...);
+
+// Directory separator, and paths in the form accepted by fstreams. Standard libraries
+// other than MSVC's can't open wide paths, so only ASCII ones work there.
+#ifdef _WIN32
+const wchar_t path_separator = L'\\';
+
+inline const std::wstring& native_path(const std::wstring& path)
+{
+	return path;
+}
+#else
+const wchar_t path_separator = L'/';
+
+inline std::string native_path(const std::wstring& path)
+{
+	return std::string(path.begin(), path.end());
+}
+#endif
+
 std::string read_whole_file(const std::string& path);
 std::string read_whole_file(const std::wstring& path);
+void write_whole_file(const std::wstring& path, const std::string& data);
 
 template<typename ...Args>
 std::string format(const std::string& format, Args ...args)
@@ -33,7 +63,7 @@ std::string format(const std::string& format, Args ...args)
 	auto size = snprintf(nullptr, 0, format.c_str(), args...) + 1; // +1: Space for '\0'
 	std::unique_ptr<char[]> buf(new char[size]);
 	snprintf(buf.get(), size, format.c_str(), args...);
-	return string(buf.get(), buf.get() + size - 1); // -1 removes '\0'
+	return std::string(buf.get(), buf.get() + size - 1); // -1 removes '\0'
 }
 
 std::map<std::string, uint> parse_map_file(std::string map_file_path);
@@ -0,0 +1,153 @@
+; Runtime for imports converted to delay-load. Placement of this code will be set to RVA
+; of destination memory (using ORG directive), so label values are RVAs. The code is
+; position-independent (it adds the image base computed at runtime), so it needs no
+; relocations.
+;
+; Generated code following this file defines `__iat_protection` (the protection IAT slots
+; get while being written), invokes `delay_stub` for every delayed import,
+; then `__data_begin:` (which starts a separate, writable section), `delay_runtime_data`
+; and the tables described by `delay_module`, `delay_import` and `delay_descriptor`.
+__begin_marker: ; Used by our .map parser
+
+; Resolves delayed import given as the only stack argument, stores its address in the
+; IAT slot and returns it in eax. Preserves ecx and edx only through the stubs.
+__delay_resolve:
+	push ebx
+	push esi
+	push edi
+	call .base
+.base:
+	pop ebx
+	sub ebx, .base             ; ebx = image base
+	mov esi, [esp + 16]        ; Import index
+	shl esi, 4
+	lea esi, [ebx + esi + __delay_imports]
+	mov edi, [esi]             ; Module index
+	lea edi, [ebx + edi * 8 + __delay_modules]
+	mov eax, [edi + 4]         ; Cached HMODULE
+	test eax, eax
+	jnz .have_module
+	mov eax, [edi]
+	add eax, ebx
+	push eax
+	call [ebx + __imp_LoadLibraryA]
+	test eax, eax
+	jz .fail
+	mov [edi + 4], eax         ; Threads racing here just load the module twice
+.have_module:
+	mov ecx, [esi + 4]         ; IMAGE_IMPORT_BY_NAME
+	test ecx, ecx
+	jz .by_ordinal
+	lea ecx, [ebx + ecx + 2]   ; Skip the hint
+	jmp .get_proc
+.by_ordinal:
+	mov ecx, [esi + 8]
+.get_proc:
+	push ecx
+	push eax
+	call [ebx + __imp_GetProcAddress]
+	test eax, eax
+	jz .fail
+	; IAT is usually read-only after the loader is done with it. Changing its protection
+	; and restoring it isn't atomic, so threads take turns here; otherwise one could
+	; restore the protection before another one writes its slot.
+	mov edi, eax
+	mov esi, [esi + 12]
+	add esi, ebx               ; IAT slot
+.acquire:
+	mov eax, 1
+	xchg eax, [ebx + __delay_lock] ; Implicitly locked
+	test eax, eax
+	jz .acquired
+	call [ebx + __imp_SwitchToThread]
+	jmp .acquire
+.acquired:
+	sub esp, 4                 ; Old protection
+	push esp
+	push __iat_protection
+	push 4
+	push esi
+	call [ebx + __imp_VirtualProtect]
+	test eax, eax
+	jz .not_stored             ; The slot keeps pointing to the stub, which resolves it again
+	mov [esi], edi
+	mov eax, [esp]
+	push esp
+	push eax
+	push 4
+	push esi
+	call [ebx + __imp_VirtualProtect]
+.not_stored:
+	add esp, 4
+	mov dword [ebx + __delay_lock], 0 ; Stores aren't reordered with earlier ones on x86
+	mov eax, edi
+	pop edi
+	pop esi
+	pop ebx
+	ret 4
+.fail:
+	int3                       ; Missing DLL or function, nothing sensible to return.
+
+%macro delay_stub 1 ; Args: import index
+	delay_stub_%1: ; IAT slot of the import initially points here
+		push ecx   ; Arguments of fastcall and thiscall functions
+		push edx
+		push %1
+		place_branch 5
+		call __delay_resolve
+		pop edx
+		pop ecx
+		place_branch 2
+		jmp eax
+%endmacro
+
+; Imports used by the runtime itself, with an import descriptor pointing to them.
+%macro delay_runtime_data 0
+	align 4, db 0
+	__kernel32_int:
+		dd __name_LoadLibraryA, __name_GetProcAddress, __name_VirtualProtect
+		dd __name_SwitchToThread, 0
+	__kernel32_iat:
+	__imp_LoadLibraryA:
+		dd __name_LoadLibraryA
+	__imp_GetProcAddress:
+		dd __name_GetProcAddress
+	__imp_VirtualProtect:
+		dd __name_VirtualProtect
+	__imp_SwitchToThread:
+		dd __name_SwitchToThread
+		dd 0
+	__name_LoadLibraryA:
+		dw 0
+		db 'LoadLibraryA', 0
+	align 2, db 0
+	__name_GetProcAddress:
+		dw 0
+		db 'GetProcAddress', 0
+	align 2, db 0
+	__name_VirtualProtect:
+		dw 0
+		db 'VirtualProtect', 0
+	align 2, db 0
+	__name_SwitchToThread:
+		dw 0
+		db 'SwitchToThread', 0
+	__kernel32_name:
+		db 'KERNEL32.dll', 0
+	align 4, db 0
+	__delay_lock:
+		dd 0               ; Held while IAT protection is changed
+%endmacro
+
+%macro delay_module 1 ; Args: module name (RVA)
+	dd %1, 0 ; Name, cached HMODULE
+%endmacro
+
+%macro delay_import 4 ; Args: module index, IMAGE_IMPORT_BY_NAME (RVA, 0 if by ordinal), ordinal, IAT slot (RVA)
+	dd %1, %2, %3, %4
+%endmacro
+
+; ImgDelayDescr (RVA-based), describing delayed imports for tools.
+%macro delay_descriptor 4 ; Args: module name (RVA), module index, IAT (RVA), INT (RVA)
+	dd 1, %1, __delay_modules + %2 * 8 + 4, %3, %4, 0, 0, 0
+%endmacro
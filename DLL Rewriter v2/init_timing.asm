@@ -0,0 +1,79 @@
+; Load-time timing thunks (--init-timing). The entry point and TLS callbacks are replaced
+; with `init_thunk`s, which call the original through `__init_timed_call` and add its
+; rdtsc delta to the record of the callback and reason code (layout is described in
+; InitTimingFormat.h). Label values are RVAs (set with ORG) and the code is
+; position-independent.
+;
+; Generated code following this file defines `__init_records` (RVA of the records) and
+; invokes `init_thunk` for every callback.
+
+%define INIT_REASONS 4
+%define INIT_RECORD_SIZE 32
+
+; Called from a thunk with the original callback (RVA) and its index on the stack, above
+; the return address and arguments of the loader's call: (hinstance, reason, reserved).
+; Both DllMain and TLS callbacks are stdcall with these arguments.
+__init_timed_call:
+	push ebx
+	push esi
+	push edi
+	push ebp
+	; [esp + 16]: callback, [esp + 20]: index, [esp + 24]: return to the loader,
+	; [esp + 28]: hinstance, [esp + 32]: reason, [esp + 36]: reserved
+	call .base
+.base:
+	pop ebx
+	sub ebx, .base                       ; ebx = image base
+	rdtsc
+	mov esi, eax
+	mov edi, edx
+	push dword [esp + 36]                ; reserved
+	push dword [esp + 36]                ; reason
+	push dword [esp + 36]                ; hinstance
+	mov eax, [esp + 28]
+	add eax, ebx
+	call eax                             ; Pops its arguments
+	mov ebp, eax                         ; DllMain's result, ignored for TLS callbacks
+	rdtsc
+	sub eax, esi
+	sbb edx, edi                         ; edx:eax = cycles
+	mov ecx, [esp + 32]
+	cmp ecx, INIT_REASONS
+	jae .done
+	mov esi, [esp + 20]
+	imul esi, esi, INIT_REASONS
+	add esi, ecx
+	shl esi, 5                           ; * INIT_RECORD_SIZE
+	lea esi, [ebx + esi + __init_records]
+	; The loader lock serializes callbacks, so plain read-modify-writes are enough.
+	add dword [esi], 1                   ; calls
+	adc dword [esi + 4], 0
+	add [esi + 8], eax                   ; total_cycles
+	adc [esi + 12], edx
+	mov [esi + 24], eax                  ; last_cycles
+	mov [esi + 28], edx
+	cmp edx, [esi + 20]                  ; max_cycles
+	jb .done
+	ja .new_max
+	cmp eax, [esi + 16]
+	jbe .done
+.new_max:
+	mov [esi + 16], eax
+	mov [esi + 20], edx
+.done:
+	mov eax, ebp
+	pop ebp
+	pop edi
+	pop esi
+	pop ebx
+	add esp, 8                           ; Callback and index pushed by the thunk
+	ret 12
+
+; The label doesn't end with the index, so it isn't taken for a thunk of an export with
+; the same index (see ThunkSymbols.h).
+%macro init_thunk 2 ; Args: original callback (RVA), callback index
+	__init%2_thunk:
+		push %2
+		push %1
+		jmp __init_timed_call
+%endmacro
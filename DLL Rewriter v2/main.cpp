@@ -1,121 +1,302 @@
 #include <cstdio>
-#include <fstream>
+#include <cstring>
+#include <cwchar>
+#include <string>
+#include <vector>
 
-#include <Windows.h>
+#ifdef _WIN32
+#include <conio.h> // for _getch()
+#include <fcntl.h>
+#include <io.h>
+#endif
 
-#include "PElib.h"
+#include "Delta.h"
+#include "PEView.h"
+#include "Reloc.h"
+#include "Rewriter.h"
+#include "Scan.h"
+#include "TemplateRules.h"
 #include "common.h"
 
-using std::ios;
-using std::map;
-using std::ofstream;
 using std::string;
+using std::vector;
 using std::wstring;
 
-using PElib::PE;
-using PElib::RVA;
-using PElib::VA;
-using PElib::FILE_OFFSET;
-using PElib::PTR;
-
 using namespace std::string_literals;
 
-bool is_export_forwarded(const IMAGE_DATA_DIRECTORY& exports_dir, RVA exported_rva)
+static void set_binary_mode(FILE* file)
 {
-	return exports_dir.VirtualAddress <= exported_rva.val
-		&& exported_rva.val < exports_dir.VirtualAddress + exports_dir.Size;
+#ifdef _WIN32
+	_setmode(_fileno(file), _O_BINARY);
+#else
+	(void)file; // There is no text mode elsewhere
+#endif
 }
 
-int wmain(int argc, const wchar_t* argv[])
+// "-" stands for stdin/stdout, which are switched to binary mode.
+static string read_input(const wstring& path)
+{
+	if (path != L"-")
+		return read_whole_file(path);
+	set_binary_mode(stdin);
+	string res;
+	char buf[0x10000];
+	size_t read;
+	while ((read = fread(buf, 1, sizeof(buf), stdin)) > 0)
+		res.append(buf, read);
+	if (ferror(stdin))
+		fatal_error("Cannot read standard input");
+	return res;
+}
+
+static void write_output(const wstring& path, const string& data)
+{
+	if (path != L"-")
+	{
+		write_whole_file(path, data);
+		return;
+	}
+	set_binary_mode(stdout);
+	if (fwrite(data.data(), 1, data.size(), stdout) != data.size() || fflush(stdout) != 0)
+		fatal_error("Cannot write standard output");
+}
+
+// Headers and sections keep their layout, so only the changed bytes are written.
+static void rebase_in_place(const wstring& path, uint new_base)
+{
+	string data = read_whole_file(path);
+	auto result = Rewriter::RebaseDll(data, new_base);
+	if (!result.ok)
+		fatal_error("%ls: %s", path.c_str(), result.error.c_str());
+	PElib::ApplyDeltaToFile(path, PElib::MakeDelta(data, result.image));
+}
+
+static int run(int argc, const wchar_t* argv[])
 {
+	if (argc >= 2 && argv[1] == L"--apply-delta"s)
+	{
+		if (argc < 4)
+			fatal_error("Usage: --apply-delta <delta file> <file to patch>");
+		PElib::ApplyDeltaToFile(argv[3], read_whole_file(wstring(argv[2])));
+		puts("Done!");
+		return 0;
+	}
+
+	if (argc >= 2 && argv[1] == L"--scan"s)
+	{
+		uint threads = 0;
+		vector<wstring> paths;
+		for (int i = 2; i < argc; i++)
+		{
+			if (argv[i] == L"--threads"s && i + 1 < argc)
+				threads = wcstoul(argv[++i], nullptr, 10);
+			else
+				paths.push_back(argv[i]);
+		}
+		if (paths.empty())
+			fatal_error("Usage: --scan [--threads <count>] <file or directory>...");
+		for (const auto& summary : PElib::ScanFiles(PElib::ExpandScanPaths(paths), threads))
+			puts(PElib::FormatScanSummary(summary).c_str());
+		return 0;
+	}
+
+	if (argc >= 2 && argv[1] == L"--rebase"s)
+	{
+		if (argc < 4)
+			fatal_error("Usage: --rebase <file> <new base (hex)>");
+		rebase_in_place(argv[2], wcstoul(argv[3], nullptr, 16));
+		puts("Done!");
+		return 0;
+	}
+
+	if (argc >= 2 && argv[1] == L"--rebase-all"s)
+	{
+		if (argc < 4)
+			fatal_error("Usage: --rebase-all <first base (hex)> <file>...");
+		vector<uint> sizes;
+		for (int i = 3; i < argc; i++)
+			sizes.push_back(PElib::PEView::Load(argv[i])->OptionalHeader().SizeOfImage);
+		auto bases = PElib::PlanBases(sizes, wcstoul(argv[2], nullptr, 16), 0x80000000);
+		for (int i = 3; i < argc; i++)
+		{
+			printf("%08x %ls\n", bases[i - 3], argv[i]);
+			rebase_in_place(argv[i], bases[i - 3]);
+		}
+		puts("Done!");
+		return 0;
+	}
+
 	if (argc < 2)
 		fatal_error("Please specify DLL path in argv[1]");
 	if (argc < 3)
 		fatal_error("Please specify a path to redirection code in argv[2]");
 
-	PE dll(argv[1]);
-	wstring asm_path = argv[2];
-	// Find free RVA for new section
-	auto free_rva = dll.NextFreeRVA();
+	Rewriter::Options options;
+	bool write_delta = false;
+	bool write_symbols = false;
+	wstring delay_runtime_path = L"delay_load.asm";
+	wstring trace_runtime_path = L"trace.asm";
+	wstring init_timing_runtime_path = L"init_timing.asm";
+	vector<Rewriter::Variant> variants(1); // The first one is argv[2]
+	wstring dll_path = argv[1];
+	wstring output_path;
+	wstring module_name;
+	for (int i = 3; i < argc; i++)
+	{
+		wstring arg = argv[i];
+		if (arg == L"--search-path" && i + 1 < argc)
+			options.search_path.push_back(argv[++i]);
+		else if (arg == L"--rebuild-exports")
+			options.rebuild_exports = true;
+		else if (arg == L"--bind")
+			options.bind = true;
+		else if (arg == L"--compact")
+			options.compact = true;
+		else if (arg == L"--detour")
+			options.detour = true;
+		else if (arg == L"--pointer-table")
+			options.pointer_table = true;
+		else if (arg == L"--export-hash")
+			options.export_hash = true;
+		else if (arg == L"--delay-load" && i + 1 < argc)
+		{
+			wstring module = argv[++i];
+			options.delay_load.push_back(string(module.begin(), module.end()));
+		}
+		else if (arg == L"--delay-runtime" && i + 1 < argc)
+			delay_runtime_path = argv[++i];
+		else if (arg == L"--trace" && i + 1 < argc)
+		{
+			wstring symbol = argv[++i];
+			options.trace.push_back(string(symbol.begin(), symbol.end()));
+		}
+		else if (arg == L"--trace-runtime" && i + 1 < argc)
+			trace_runtime_path = argv[++i];
+		else if (arg == L"--init-timing")
+			options.init_timing = true;
+		else if (arg == L"--init-timing-runtime" && i + 1 < argc)
+			init_timing_runtime_path = argv[++i];
+		else if (arg == L"--delta")
+			write_delta = true;
+		else if (arg == L"--thunk-symbols")
+			write_symbols = true;
+		else if (arg == L"--profile" && i + 1 < argc)
+			options.profile = read_whole_file(wstring(argv[++i]));
+		else if (arg == L"--rules" && i + 1 < argc)
+			options.template_rules = read_whole_file(wstring(argv[++i]));
+		else if (arg == L"--output" && i + 1 < argc)
+			output_path = argv[++i];
+		else if (arg == L"--module-name" && i + 1 < argc)
+			module_name = argv[++i];
+		else if (arg == L"--branch-boundary" && i + 1 < argc)
+			options.branch_boundary = wcstoul(argv[++i], nullptr, 10);
+		else if (arg == L"--private-scratch")
+			options.private_scratch = true;
+		else if (arg == L"--variant" && i + 2 < argc)
+		{
+			variants.push_back(Rewriter::Variant{ read_whole_file(wstring(argv[i + 1])), argv[i + 2] });
+			i += 2;
+		}
+		else
+			fatal_error("Unknown argument: %ls", argv[i]);
+	}
 
-	// Load assembly code
-	string users_source = read_whole_file(asm_path);
+	if (!options.delay_load.empty())
+		options.delay_runtime = read_whole_file(delay_runtime_path);
+	if (!options.trace.empty()
+		|| PElib::RulesUseMacro(PElib::ParseTemplateRules(options.template_rules), "trace_redirect"))
+		options.trace_runtime = read_whole_file(trace_runtime_path);
+	if (options.init_timing)
+		options.init_timing_runtime = read_whole_file(init_timing_runtime_path);
 
-	// Parse export table
-	const auto& exports_dir_entry = dll.Directory(IMAGE_DIRECTORY_ENTRY_EXPORT);
-	IMAGE_EXPORT_DIRECTORY export_directory;
+	// Streaming: DLL from stdin ("-") goes to stdout by default, with messages on stderr,
+	// and nothing is left in the current directory.
+	bool from_stdin = dll_path == L"-";
+	if (output_path.empty())
+		output_path = from_stdin ? L"-" : dll_path + (write_delta ? L".delta" : L".rebuilt.dll");
+	FILE* log = output_path == L"-" ? stderr : stdout;
+	if (from_stdin || output_path == L"-")
+		options.private_scratch = true;
+	if (write_symbols && from_stdin)
+		fatal_error("--thunk-symbols needs the DLL to be read from a file");
 
-	if (!exports_dir_entry.VirtualAddress || !exports_dir_entry.Size)
-	{
-		fatal_error("This DLL doesn't have an export table, nothing to do.");
-	}
-	else if (exports_dir_entry.Size < sizeof(IMAGE_EXPORT_DIRECTORY))
+	if (module_name.empty() && !from_stdin)
 	{
-		fatal_error("Invalid export table size!");
+		auto name_pos = dll_path.find_last_of(L"\\/");
+		module_name = name_pos == wstring::npos ? dll_path : dll_path.substr(name_pos + 1);
 	}
+	options.module_name = string(module_name.begin(), module_name.end());
+
+	string dll_data = read_input(dll_path);
+	variants[0].redirect_source = read_whole_file(wstring(argv[2]));
+	// Additional variants are written by the rewriter itself, the first one is handled here.
+	vector<Rewriter::Result> results;
+	if (variants.size() == 1)
+		results.push_back(Rewriter::RewriteDll(dll_data, variants[0].redirect_source, options));
 	else
+		results = Rewriter::RewriteVariants(dll_data, variants, options);
+	bool failed = false;
+	for (size_t i = 0; i < results.size(); i++)
 	{
-		// Load IMAGE_EXPORT_DIRECTORY struct from in-memory file data
-		auto rva = RVA{ exports_dir_entry.VirtualAddress };
-		auto section = dll.SectionFromRVA(rva);
-		auto size = sizeof(export_directory);
-		if (section.SizeOfRawData - (rva.val - section.VirtualAddress) < size)
+		const auto& result = results[i];
+		wstring base_path = i ? variants[i].output_path : dll_path;
+		if (i)
+			fprintf(log, "%ls:\n", base_path.c_str());
+		for (const auto& message : result.messages)
+			fprintf(log, "%s\n", message.c_str());
+		if (!result.ok)
+		{
+			fprintf(log, "Error: %s\n", result.error.c_str());
+			failed = true;
+		}
+		else if (write_symbols)
 		{
-			// Export table crosses section boundary or file data,
-			// we're skipping this case for simplicity.
-			fatal_error("Unsupported export table location");
+			write_whole_file(base_path + L".thunks.map", result.symbol_map);
+			write_whole_file(base_path + L".thunks.sym", result.symbol_table);
 		}
-		auto export_table_ptr = dll.ConvertTo<PTR>(rva).val;
-		memcpy(&export_directory, export_table_ptr, size);
 	}
+	if (failed)
+		fatal_error("Rewriting failed");
+	const auto& result = results[0];
+	// Only changed ranges of the original file are stored in a delta.
+	write_output(output_path, write_delta ? PElib::MakeDelta(dll_data, result.image)
+	                                      : result.image);
+	fputs("Done!\n", log);
+	return 0;
+}
 
-	// Find array with addresses of exported symbols
-	auto exported_functions = (uint*)dll.ConvertTo<PTR>(RVA{ export_directory.AddressOfFunctions }).val;
-
-	// Generate assembly code containing wrappers for exported functions
-	string generated_prefix = "__tmp_generated";
-	ofstream gen_file(generated_prefix + ".asm", ios::binary);
-	gen_file << "[bits 32]\n";
-	gen_file << format("[org 0%08xh]\n", free_rva);
-	gen_file << "[map symbols " << generated_prefix << ".map]\n";
-	gen_file << users_source;
-	gen_file << "\n";
-
-	// Generate `redirect` macro call for every exported function,
-	// passing function address and index as arguments.
-	for (DWORD i = 0; i < export_directory.NumberOfFunctions; i++)
+static int run_reporting_errors(int argc, const wchar_t* argv[])
+{
+	try
 	{
-		auto func_addr = RVA{ exported_functions[i] };
-		if (dll.IsAddrExecutable(func_addr) && !is_export_forwarded(exports_dir_entry, func_addr))
-			gen_file << format("redirect 0%08xh, %d\n", func_addr, i);
+		return run(argc, argv);
 	}
-	gen_file.close();
-
-	// Compile generated code using nasm
-	auto command = format(R"(nasm "%s.asm" -O0 -o "%s.bin")",
-	                      generated_prefix.c_str(),
-						  generated_prefix.c_str());
-	// Using system() is generally a bad thing, but it's the simplest solution here.
-	system(command.c_str());
-
-	// Prepare new section and place compiled assembly in it.
-	string compiled = read_whole_file(generated_prefix + ".bin");
-	dll.AddSection("wrappers",
-	               free_rva,
-				   align_up(compiled.size(), dll.OptionalHeader().SectionAlignment),
-				   compiled,
-				   IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_EXECUTE);
-
-	// Change function pointers in export table so they point to generated wrappers.
-	map<string, uint> labels = parse_map_file(generated_prefix + ".map");
-	for (DWORD i = 0; i < export_directory.NumberOfFunctions; i++)
+	catch (const FatalError& e)
 	{
-		auto func_addr = RVA{ exported_functions[i] };
-		if (dll.IsAddrExecutable(func_addr) && !is_export_forwarded(exports_dir_entry, func_addr))
-			exported_functions[i] = labels[format("entry_%d", i)];
+		fprintf(stderr, "Error: %s\n", e.what());
+#if defined(_MSC_VER) && defined(_DEBUG)
+		puts("[Press any key]");
+		_getch();
+#endif
+		return 1;
 	}
+}
 
-	dll.Save(argv[1] + L".rebuilt.dll"s);
-	puts("Done!");
-	return 0;
+#ifdef _WIN32
+int wmain(int argc, const wchar_t* argv[])
+{
+	return run_reporting_errors(argc, argv);
+}
+#else
+// Arguments are widened byte by byte, like paths are narrowed by native_path().
+int main(int argc, const char* argv[])
+{
+	vector<wstring> args;
+	for (int i = 0; i < argc; i++)
+		args.push_back(wstring(argv[i], argv[i] + strlen(argv[i])));
+	vector<const wchar_t*> wide_argv;
+	for (const auto& arg : args)
+		wide_argv.push_back(arg.c_str());
+	return run_reporting_errors(argc, wide_argv.data());
 }
+#endif
@@ -0,0 +1,18 @@
+; Placement of this code will be set to RVA (not VA!) of destination memory
+; (using ORG directive).
+;
+; Wrappers jumping through a per-export slot of the pointer table, so targets can be
+; switched at runtime (see PointerTableFormat.h). Requires --pointer-table, which
+; defines `__pointer_slots` (VA of slot 0). The original function address passed to
+; `redirect` is already in the slot. There are no spare bytes before `entry_<index>`,
+; so HotPatcher (see HotPatch.h) rejects these wrappers; switch the slot instead.
+__begin_marker: ; Used by our .map parser
+
+%macro redirect 2 ; Args: func address (RVA), func index
+	place_branch 6
+	entry_%2: ; entry_<index> label will be pointed by an exported symbol with this index
+		db 0FFh, 25h                ; jmp [dword slot]
+	__fixup_%2:                     ; Absolute address, the rewriter adds a relocation for it
+		dd __pointer_slots + %2 * 4
+	align 8, int3
+%endmacro
@@ -1,13 +1,20 @@
 ; Placement of this code will be set to RVA (not VA!) of destination memory
 ; (using ORG directive).
+;
+; `place_branch <size>` is defined by the rewriter before this file. It pads with nops
+; when the next branch would cross the boundary selected with --branch-boundary, and
+; expands to nothing by default. With this layout both jumps always fit, so it never
+; pads here, but templates with longer wrappers should use it before every branch.
 __begin_marker: ; Used by our .map parser
 
 %macro redirect 2 ; Args: func address (RVA), func index
+	place_branch 5
 	longjmp_%2:
 		jmp %1 ; Jump to original function. 'jmp' is relative so we don't
 		       ; have to know target VA (relative distance is enough).
 	times 5 nop    ; Allows hot-patching.
 	align 16, nop  ; Alignment to 16
+	place_branch 2
 	entry_%2: ; entry_<index> label will be pointed by an exported symbol with this index
 		jmp short longjmp_%2 ; First instruction must be at least 2-bytes long
 		                     ; for hot-patching support.
@@ -0,0 +1,138 @@
+/*
+Test of ExportIndex (Exports.h) on DLLs with aliased exports, i.e. several names pointing
+to the same ordinal. Checks lookups, the sorted names check, and that rebuilding the export
+directory keeps every name, and that template rules match aliases. Portable; exits with 1
+on failure:
+	g++ -O2 -std=c++14 -I.. exports_test.cpp ../Exports.cpp ../ExportHashBuilder.cpp ../TemplateRules.cpp ../PEView.cpp ../PEImage.cpp ../PElib.cpp ../common.cpp -o exports_test
+	./exports_test
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <utility>
+
+#include "Exports.h"
+#include "TemplateRules.h"
+#include "test_image.h"
+
+using namespace PElib;
+using std::map;
+using std::pair;
+using std::string;
+using std::vector;
+
+static const uint32_t text_rva = 0x1000;
+static const uint32_t rdata_rva = 0x2000;
+
+static int failures = 0;
+
+static void check(bool condition, const char* what)
+{
+	printf("%-50s %s\n", what, condition ? "ok" : "FAILED");
+	if (!condition)
+		failures++;
+}
+
+// Three functions, with `names` (in AddressOfNames order) pointing to their indexes.
+static string make_dll(const vector<pair<string, uint16_t>>& names)
+{
+	uint32_t count = names.size();
+	uint32_t functions_offset = sizeof(PeExportDirectory);
+	uint32_t names_offset = functions_offset + 3 * 4;
+	uint32_t ordinals_offset = names_offset + count * 4;
+	uint32_t strings_offset = ordinals_offset + count * 2;
+
+	string rdata(0x200, '\0');
+	PeExportDirectory exports = {};
+	exports.Base = 1;
+	exports.NumberOfFunctions = 3;
+	exports.NumberOfNames = count;
+	exports.AddressOfFunctions = rdata_rva + functions_offset;
+	exports.AddressOfNames = rdata_rva + names_offset;
+	exports.AddressOfNameOrdinals = rdata_rva + ordinals_offset;
+	memcpy(&rdata[0], &exports, sizeof(exports));
+	for (uint32_t i = 0; i < 3; i++)
+		test_write32(rdata, functions_offset + i * 4, text_rva + i * 0x10);
+	uint32_t pos = strings_offset;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		test_write32(rdata, names_offset + i * 4, rdata_rva + pos);
+		memcpy(&rdata[ordinals_offset + i * 2], &names[i].second, sizeof(uint16_t));
+		memcpy(&rdata[pos], names[i].first.c_str(), names[i].first.size() + 1);
+		pos += names[i].first.size() + 1;
+	}
+
+	vector<TestSection> sections = {
+		{ ".text", string(0x30, '\xC3'), pe_scn_cnt_code | pe_scn_mem_execute | pe_scn_mem_read },
+		{ ".rdata", rdata, pe_scn_cnt_initialized_data | pe_scn_mem_read },
+	};
+	return build_test_dll(sections, 0x10000000, 0, { { pe_directory_export, { rdata_rva, pos } } });
+}
+
+static map<string, uint> names_of(const ExportIndex& index)
+{
+	map<string, uint> res;
+	for (const auto& name : index.Names())
+		res[index.NameString(name)] = name.index;
+	return res;
+}
+
+static string rebuild(const string& data)
+{
+	auto view = std::make_shared<const PEView>(data);
+	PEEdit pe(view);
+	WriteExportDirectory(pe, ExportIndex(*view));
+	return pe.Build();
+}
+
+int main()
+{
+	const map<string, uint> expected = {
+		{ "Alpha", 0 }, { "AlphaEx", 0 }, { "Beta", 1 }, { "Gamma", 2 }, { "GammaW", 2 },
+	};
+
+	string sorted = make_dll({ { "Alpha", 0 }, { "AlphaEx", 0 }, { "Beta", 1 }, { "Gamma", 2 },
+	                           { "GammaW", 2 } });
+	PEView sorted_view(sorted);
+	ExportIndex index(sorted_view);
+	check(names_of(index) == expected, "every alias is indexed");
+	check(index.NamesSorted(), "sorted names with aliases are sorted");
+	check(index.FindByName("Alpha") == index.FindByName("AlphaEx")
+	      && index.FindByName("AlphaEx")->ordinal == 1, "aliases find the same export");
+	check(index[0].name == "Alpha" && index[2].name == "Gamma", "first name is the export's name");
+
+	string rebuilt = rebuild(sorted);
+	PEView rebuilt_view(rebuilt);
+	ExportIndex rebuilt_index(rebuilt_view);
+	const auto& rebuilt_directory = rebuilt_index.Directory();
+	check(rebuilt_directory.NumberOfNames == expected.size(), "rebuilt directory has every name");
+	check(names_of(rebuilt_index) == expected && rebuilt_index.NamesSorted(),
+	      "rebuilt names are the same and sorted");
+
+	string unsorted = make_dll({ { "GammaW", 2 }, { "Alpha", 0 }, { "Gamma", 2 }, { "Beta", 1 },
+	                             { "AlphaEx", 0 } });
+	PEView unsorted_view(unsorted);
+	ExportIndex unsorted_index(unsorted_view);
+	check(!unsorted_index.NamesSorted(), "unsorted names are detected");
+	check(unsorted_index.FindByName("GammaW") == &unsorted_index[2]
+	      && unsorted_index.FindByName("Alpha") == &unsorted_index[0]
+	      && !unsorted_index.FindByName("Delta"), "unsorted names are found");
+	string fixed = rebuild(unsorted);
+	PEView fixed_view(fixed);
+	ExportIndex fixed_index(fixed_view);
+	check(names_of(fixed_index) == expected && fixed_index.NamesSorted(),
+	      "rebuilding sorts names and keeps aliases");
+
+	auto templates = SelectTemplates(ParseTemplateRules("GammaW trace_redirect\nAlpha?? redirect\n"),
+	                                 index);
+	check(templates == vector<string>({ "redirect", "", "trace_redirect" }),
+	      "template rules match aliases");
+
+	PEEdit hashed(std::make_shared<const PEView>(sorted));
+	check(WriteExportHash(hashed, index) == expected.size(), "export hash has every alias");
+
+	printf(failures ? "%d check(s) failed\n" : "All checks passed\n", failures);
+	return failures ? 1 : 0;
+}
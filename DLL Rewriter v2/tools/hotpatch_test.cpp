@@ -0,0 +1,176 @@
+/*
+Test of HotPatch.h on wrappers laid out like short_jmp.asm. Builds a minimal loaded image
+in an RWX buffer: headers, a "wrappers" section with wrappers and their metadata, and
+target functions returning distinct values. Checks the metadata lookup, redirected calls,
+re-hooking, restores, rejected layouts, and that calls racing with patching always reach
+either the original or the hook.
+
+Linux/x86 only; exits with 1 on failure:
+	g++ -O2 -std=c++14 -pthread -I.. hotpatch_test.cpp ../HotPatch.cpp ../common.cpp -o hotpatch_test
+	./hotpatch_test
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "HotPatch.h"
+#include "PEFormat.h"
+
+using namespace PElib;
+using std::vector;
+
+typedef int (*Func)();
+
+static const uint32_t exports = 4;
+static const uint32_t wrappers_rva = 0x1000;
+static const uint32_t targets_rva = 0x2000;
+static const uint32_t hooks_rva = 0x2800;
+static const uint32_t image_size = 0x3000;
+static const uint32_t target_stride = 16;
+
+static int failures = 0;
+
+static void check(bool condition, const char* what)
+{
+	printf("%-50s %s\n", what, condition ? "ok" : "FAILED");
+	if (!condition)
+		failures++;
+}
+
+// `mov eax, value; ret`
+static void emit_return(uint8_t* code, int32_t value)
+{
+	code[0] = 0xB8;
+	memcpy(code + 1, &value, sizeof(value));
+	code[5] = 0xC3;
+}
+
+static void emit_headers(uint8_t* image)
+{
+	auto& dos = *(PeDosHeader*)image;
+	dos.e_magic = pe_dos_signature;
+	dos.e_lfanew = sizeof(PeDosHeader);
+	auto& nt = *(PeNtHeaders32*)(image + dos.e_lfanew);
+	nt.Signature = pe_nt_signature;
+	nt.FileHeader.NumberOfSections = 1;
+	nt.FileHeader.SizeOfOptionalHeader = sizeof(PeOptionalHeader32);
+	nt.OptionalHeader.Magic = pe_optional32_magic;
+	nt.OptionalHeader.SectionAlignment = 0x1000;
+	nt.OptionalHeader.FileAlignment = 0x200;
+	nt.OptionalHeader.SizeOfImage = image_size;
+	auto& section = *(PeSectionHeader*)(image + dos.e_lfanew + sizeof(PeNtHeaders32));
+	memcpy(section.Name, "wrappers", pe_section_name_size);
+	section.VirtualAddress = wrappers_rva;
+	section.VirtualSize = section.SizeOfRawData = targets_rva - wrappers_rva;
+	section.Characteristics = pe_scn_cnt_code | pe_scn_mem_execute | pe_scn_mem_read;
+}
+
+// Same layout as the `redirect` macro from short_jmp.asm; the metadata follows the code and
+// ends a bit before the end of the section, as if raw data were padded.
+static vector<WrapperRecord> emit_wrappers(uint8_t* image)
+{
+	vector<WrapperRecord> records;
+	uint32_t pos = wrappers_rva;
+	for (uint32_t index = 0; index < exports; index++)
+	{
+		uint32_t longjmp = pos;
+		uint32_t target = targets_rva + index * target_stride;
+		int32_t rel = (int32_t)(target - (longjmp + 5));
+		image[pos++] = 0xE9; // jmp rel32
+		memcpy(image + pos, &rel, sizeof(rel));
+		pos += sizeof(rel);
+		for (int i = 0; i < 5; i++) // times 5 nop
+			image[pos++] = 0x90;
+		while (pos % 16) // align 16, nop
+			image[pos++] = 0x90;
+		records.push_back(WrapperRecord{ index, target, pos });
+		image[pos++] = 0xEB; // jmp short longjmp
+		image[pos] = (uint8_t)(longjmp - (pos + 1));
+		pos++;
+		emit_return(image + target, 100 + index);
+	}
+
+	WrappersTrailer trailer;
+	memcpy(trailer.magic, wrappers_magic, sizeof(trailer.magic));
+	trailer.version = wrappers_version;
+	trailer.count = exports;
+	trailer.records_rva = targets_rva - 0x40 - sizeof(trailer) - exports * sizeof(WrapperRecord);
+	memcpy(image + trailer.records_rva, records.data(), exports * sizeof(WrapperRecord));
+	memcpy(image + trailer.records_rva + exports * sizeof(WrapperRecord), &trailer, sizeof(trailer));
+	return records;
+}
+
+int main()
+{
+	auto image = (uint8_t*)mmap(nullptr, image_size, PROT_READ | PROT_WRITE | PROT_EXEC,
+	                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (image == MAP_FAILED)
+	{
+		perror("mmap");
+		return 1;
+	}
+	emit_headers(image);
+	auto expected = emit_wrappers(image);
+	emit_return(image + hooks_rva, 1000);
+	emit_return(image + hooks_rva + target_stride, 2000);
+	const void* hook = image + hooks_rva;
+	const void* other_hook = image + hooks_rva + target_stride;
+	auto call = [&](uint32_t index) { return ((Func)(image + expected[index].entry_rva))(); };
+
+	vector<WrapperRecord> records;
+	check(ReadLoadedWrappers(image, &records) && records.size() == exports
+	      && memcmp(records.data(), expected.data(), exports * sizeof(WrapperRecord)) == 0,
+	      "metadata is found");
+	check(call(1) == 101 && call(2) == 102, "wrappers call originals");
+
+	HotPatcher patcher(image, records);
+	check(patcher.Apply(1, hook) == HotPatchStatus::Ok && patcher.IsApplied(1), "apply");
+	check(call(1) == 1000, "patched call reaches the hook");
+	check(call(0) == 100 && call(2) == 102, "other wrappers are untouched");
+	check(patcher.Apply(1, other_hook) == HotPatchStatus::Ok && call(1) == 2000, "change hook");
+	check(patcher.Revert(1) == HotPatchStatus::Ok && !patcher.IsApplied(1), "revert");
+	check(call(1) == 101, "reverted call reaches the original");
+	check(patcher.Revert(1) == HotPatchStatus::Ok && call(1) == 101, "revert again is a no-op");
+	check(patcher.Apply(1, hook) == HotPatchStatus::Ok && call(1) == 1000, "apply after revert");
+	check(patcher.Revert(1) == HotPatchStatus::Ok && call(1) == 101, "revert after reapply");
+	check(patcher.Apply(exports, hook) == HotPatchStatus::NoSuchExport, "unknown export");
+
+	// A second patcher sees the entry redirected by the first one as foreign.
+	check(patcher.Apply(3, hook) == HotPatchStatus::Ok, "apply for foreign patch");
+	HotPatcher foreign(image, records);
+	check(foreign.Apply(3, other_hook) == HotPatchStatus::BadLayout, "foreign patch is rejected");
+	check(patcher.Revert(3) == HotPatchStatus::Ok && call(3) == 103, "revert foreign patch");
+
+	// Calls racing with patching see either the original or the hook, never a torn entry.
+	std::atomic<bool> stop(false);
+	std::atomic<int> bad(0);
+	std::thread caller([&]
+	{
+		while (!stop)
+		{
+			int result = call(2);
+			if (result != 102 && result != 1000)
+				bad++;
+		}
+	});
+	bool all_ok = true;
+	for (int i = 0; i < 20000; i++)
+	{
+		all_ok &= patcher.Apply(2, hook) == HotPatchStatus::Ok;
+		all_ok &= patcher.Revert(2) == HotPatchStatus::Ok;
+	}
+	stop = true;
+	caller.join();
+	check(all_ok && bad == 0 && call(2) == 102, "concurrent calls during patching");
+
+	munmap(image, image_size);
+	printf(failures ? "%d check(s) failed\n" : "All checks passed\n", failures);
+	return failures ? 1 : 0;
+}
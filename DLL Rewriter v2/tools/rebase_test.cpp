@@ -0,0 +1,125 @@
+/*
+Test of Rebase() (Reloc.h) on a small DLL with HIGHLOW fixups, including one crossing
+a page boundary. Checks patched pointers, ImageBase and that TimeDateStamp is incremented
+like ReBaseImage() does, so bindings of importers become stale, and that data after the
+last section (e.g. a certificate) survives. Portable; exits with 1 on failure:
+	g++ -O2 -std=c++14 -I.. rebase_test.cpp ../Reloc.cpp ../PEView.cpp ../PEImage.cpp ../PElib.cpp ../common.cpp -o rebase_test
+	./rebase_test
+*/
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include "Reloc.h"
+#include "test_image.h"
+
+using namespace PElib;
+using std::string;
+using std::vector;
+
+static const uint32_t old_base = 0x10000000;
+static const uint32_t new_base = 0x20000000;
+static const uint32_t timestamp = 0x12345678;
+static const uint32_t fixups[] = { 0x10, 0xFFE }; // In .text, the second one crosses pages
+
+static int failures = 0;
+
+static void check(bool condition, const char* what)
+{
+	printf("%-50s %s\n", what, condition ? "ok" : "FAILED");
+	if (!condition)
+		failures++;
+}
+
+static string make_dll()
+{
+	vector<TestSection> sections = {
+		{ ".text", string(0x1002, '\x90'), pe_scn_cnt_code | pe_scn_mem_execute | pe_scn_mem_read },
+		{ ".reloc", "", pe_scn_cnt_initialized_data | pe_scn_mem_discardable | pe_scn_mem_read },
+	};
+	uint32_t text_rva = test_section_rva(sections, 0);
+	for (uint32_t offset : fixups)
+		test_write32(sections[0].data, offset, old_base + text_rva + offset);
+	RelocBlock block;
+	block.page = RVA{ text_rva };
+	for (uint32_t offset : fixups)
+		block.entries.push_back((ushort)(pe_rel_based_highlow << 12 | offset));
+	block.entries.push_back(pe_rel_based_absolute << 12); // Padding
+	sections[1].data = BuildRelocations({ block });
+	uint32_t reloc_rva = test_section_rva(sections, 1);
+	return build_test_dll(sections, old_base, timestamp,
+	                      { { pe_directory_basereloc, { reloc_rva, (uint32_t)sections[1].data.size() } } });
+}
+
+static string rebase(const string& data, uint32_t base)
+{
+	PEEdit pe(std::make_shared<const PEView>(data));
+	Rebase(pe, base);
+	return pe.BuildInPlace();
+}
+
+// PE checksum of `data` with the CheckSum field zeroed.
+static uint32_t checksum(string data)
+{
+	memset(&data[sizeof(PeDosHeader) + offsetof(PeNtHeaders32, OptionalHeader)
+	             + offsetof(PeOptionalHeader32, CheckSum)], 0, sizeof(uint32_t));
+	data.push_back('\0');
+	uint32_t sum = 0;
+	for (size_t i = 0; i + 1 < data.size(); i += 2)
+	{
+		sum += (uint8_t)data[i] | (uint8_t)data[i + 1] << 8;
+		sum = (uint16_t)sum + (sum >> 16);
+	}
+	return sum + (uint32_t)data.size() - 1;
+}
+
+static bool fixups_applied(const PEView& pe, uint32_t base)
+{
+	bool res = true;
+	for (uint32_t offset : fixups)
+	{
+		uint32_t rva = 0x1000 + offset;
+		res &= test_read32(string(pe.Pointer(RVA{ rva }, 4), 4), 0) == base + rva;
+	}
+	return res;
+}
+
+int main()
+{
+	string original = make_dll();
+	PEView before(original);
+	check(before.OptionalHeader().ImageBase == old_base
+	      && before.FileHeader().TimeDateStamp == timestamp, "test image parses");
+
+	string rebased = rebase(original, new_base);
+	PEView after(rebased);
+	check(after.OptionalHeader().ImageBase == new_base, "ImageBase is updated");
+	check(after.FileHeader().TimeDateStamp == timestamp + 1, "TimeDateStamp is incremented");
+	check(fixups_applied(after, new_base), "fixups are applied");
+
+	string same = rebase(rebased, new_base);
+	check(same == rebased, "rebasing to the current base changes nothing");
+
+	string back = rebase(rebased, old_base);
+	PEView back_view(back);
+	check(back_view.FileHeader().TimeDateStamp == timestamp + 2, "every rebase increments the stamp");
+	check(memcmp(back_view.Pointer(RVA{ 0x1000 }, 0x1002), before.Pointer(RVA{ 0x1000 }, 0x1002),
+	             0x1002) == 0, "rebasing back restores the code");
+
+	string trailing(0x300, '\xA5');
+	string signed_dll = original + trailing;
+	string rebased_signed = rebase(signed_dll, new_base);
+	check(rebased_signed.size() == signed_dll.size()
+	      && rebased_signed.compare(original.size(), trailing.size(), trailing) == 0,
+	      "data after the last section is kept");
+	PEView signed_view(rebased_signed);
+	check(signed_view.OptionalHeader().ImageBase == new_base && fixups_applied(signed_view, new_base),
+	      "image with trailing data is rebased");
+	check(signed_view.OptionalHeader().CheckSum == checksum(rebased_signed),
+	      "checksum covers the whole file");
+
+	printf(failures ? "%d check(s) failed\n" : "All checks passed\n", failures);
+	return failures ? 1 : 0;
+}
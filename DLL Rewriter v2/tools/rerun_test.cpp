@@ -0,0 +1,191 @@
+/*
+Test of processing a DLL again (see Rewriter.h). Rewrites a small DLL with exports, imports
+and relocations, converting one imported module to delay-load, then rewrites the result
+again. The second run has to drop the sections of the first one ("wrappers", "relocs",
+"delayimp", "delaydat"), so the section count and SizeOfImage stay the same, and
+a run without delay-load has to restore the original imports.
+
+Needs nasm in PATH; run from the directory with short_jmp.asm and delay_load.asm. Exits
+with 1 on failure:
+	g++ -O2 -std=c++14 -pthread -I.. rerun_test.cpp $(find .. -maxdepth 1 -name "*.cpp" ! -name main.cpp) -o rerun_test
+	cd .. && tools/rerun_test
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <set>
+
+#include "PEView.h"
+#include "Reloc.h"
+#include "Rewriter.h"
+#include "test_image.h"
+
+using namespace PElib;
+using std::set;
+using std::string;
+using std::vector;
+
+static const uint32_t image_base = 0x10000000;
+static const uint32_t text_rva = 0x1000;
+static const uint32_t rdata_rva = 0x2000;
+// Layout of .rdata
+static const uint32_t functions_offset = 0x40, names_offset = 0x50, ordinals_offset = 0x60;
+static const uint32_t imports_offset = 0x100;
+static const uint32_t kernel32_int = 0x140, user32_int = 0x148;
+static const uint32_t kernel32_iat = 0x160, user32_iat = 0x168;
+
+static int failures = 0;
+
+static void check(bool condition, const char* what)
+{
+	printf("%-60s %s\n", what, condition ? "ok" : "FAILED");
+	if (!condition)
+		failures++;
+}
+
+static void put_string(string& data, size_t offset, const char* value)
+{
+	memcpy(&data[offset], value, strlen(value) + 1);
+}
+
+static string make_dll()
+{
+	// Three exported functions; the code also uses a data pointer and calls an import.
+	string text(0x60, '\xC3');
+	text[0x50] = '\xFF'; // call [MessageBoxA]
+	text[0x51] = '\x15';
+	test_write32(text, 0x52, image_base + rdata_rva + user32_iat);
+	test_write32(text, 0x40, image_base + rdata_rva + 0x70);
+
+	string rdata(0x200, '\0');
+	PeExportDirectory exports = {};
+	exports.Name = rdata_rva + 0x70;
+	exports.Base = 1;
+	exports.NumberOfFunctions = exports.NumberOfNames = 3;
+	exports.AddressOfFunctions = rdata_rva + functions_offset;
+	exports.AddressOfNames = rdata_rva + names_offset;
+	exports.AddressOfNameOrdinals = rdata_rva + ordinals_offset;
+	memcpy(&rdata[0], &exports, sizeof(exports));
+	const char* names[] = { "alpha", "beta", "gamma" };
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		test_write32(rdata, functions_offset + i * 4, text_rva + i * 0x10);
+		test_write32(rdata, names_offset + i * 4, rdata_rva + 0x80 + i * 8);
+		uint16_t ordinal = (uint16_t)i;
+		memcpy(&rdata[ordinals_offset + i * 2], &ordinal, sizeof(ordinal));
+		put_string(rdata, 0x80 + i * 8, names[i]);
+	}
+	put_string(rdata, 0x70, "test.dll");
+
+	PeImportDescriptor descriptors[] = {
+		{ rdata_rva + kernel32_int, 0, 0, rdata_rva + 0x180, rdata_rva + kernel32_iat },
+		{ rdata_rva + user32_int, 0, 0, rdata_rva + 0x190, rdata_rva + user32_iat },
+	};
+	memcpy(&rdata[imports_offset], descriptors, sizeof(descriptors));
+	for (uint32_t table : { kernel32_int, kernel32_iat })
+		test_write32(rdata, table, rdata_rva + 0x1A0);
+	for (uint32_t table : { user32_int, user32_iat })
+	{
+		test_write32(rdata, table, rdata_rva + 0x1B0);
+		test_write32(rdata, table + 4, pe_ordinal_flag32 | 5);
+	}
+	put_string(rdata, 0x180, "KERNEL32.dll");
+	put_string(rdata, 0x190, "USER32.dll");
+	put_string(rdata, 0x1A2, "Sleep");
+	put_string(rdata, 0x1B2, "MessageBoxA");
+
+	RelocBlock block;
+	block.page = RVA{ text_rva };
+	for (uint32_t offset : { 0x40, 0x52 })
+		block.entries.push_back((ushort)(pe_rel_based_highlow << 12 | offset));
+	string relocs = BuildRelocations({ block });
+
+	vector<TestSection> sections = {
+		{ ".text", text, pe_scn_cnt_code | pe_scn_mem_execute | pe_scn_mem_read },
+		{ ".rdata", rdata, pe_scn_cnt_initialized_data | pe_scn_mem_read },
+		{ ".reloc", relocs, pe_scn_cnt_initialized_data | pe_scn_mem_discardable | pe_scn_mem_read },
+	};
+	uint32_t imports_size = (uint32_t)sizeof(descriptors) + sizeof(PeImportDescriptor);
+	return build_test_dll(sections, image_base, 0, {
+		{ pe_directory_export, { rdata_rva, 0x100 } },
+		{ pe_directory_import, { rdata_rva + imports_offset, imports_size } },
+		{ pe_directory_basereloc, { test_section_rva(sections, 2), (uint32_t)relocs.size() } },
+	});
+}
+
+static vector<string> section_names(const PEView& pe)
+{
+	vector<string> res;
+	for (const auto& section : pe.Sections())
+		res.push_back(string((const char*)section.Name, strnlen((const char*)section.Name, 8)));
+	return res;
+}
+
+static set<uint32_t> fixups(const PEView& pe)
+{
+	set<uint32_t> res;
+	for (const auto& block : ParseRelocations(pe))
+		for (ushort entry : block.entries)
+			if ((entry >> 12) == pe_rel_based_highlow)
+				res.insert(block.page.val + (entry & 0xFFF));
+	return res;
+}
+
+static string rewrite(const string& data, bool delay_load)
+{
+	Rewriter::Options options;
+	options.module_name = "test.dll";
+	options.private_scratch = true;
+	if (delay_load)
+	{
+		options.delay_load = { "USER32.dll" };
+		options.delay_runtime = read_whole_file("delay_load.asm");
+	}
+	auto result = Rewriter::RewriteDll(data, read_whole_file("short_jmp.asm"), options);
+	if (!result.ok)
+		printf("Rewriting failed: %s\n", result.error.c_str());
+	return result.image;
+}
+
+int main()
+{
+	string original = make_dll();
+	string first = rewrite(original, true);
+	string second = first.empty() ? "" : rewrite(first, true);
+	if (second.empty())
+		return 1;
+	PEView original_view(original), first_view(first), second_view(second);
+
+	check(section_names(first_view)
+	      == vector<string>({ ".text", ".rdata", ".reloc", "wrappers", "delayimp", "delaydat", "relocs" }),
+	      "first run adds wrappers, delay-load and relocations");
+	check(second_view.FileHeader().NumberOfSections == first_view.FileHeader().NumberOfSections,
+	      "second run keeps the section count");
+	check(second_view.OptionalHeader().SizeOfImage == first_view.OptionalHeader().SizeOfImage,
+	      "second run keeps SizeOfImage");
+	check(section_names(second_view) == section_names(first_view), "second run keeps section names");
+	check(fixups(second_view) == fixups(first_view), "second run keeps relocations");
+	check(second == first, "second run gives the same image");
+
+	string restored = rewrite(first, false);
+	if (restored.empty())
+		return 1;
+	PEView restored_view(restored);
+	check(section_names(restored_view)
+	      == vector<string>({ ".text", ".rdata", ".reloc", "wrappers", "relocs" }),
+	      "run without delay-load drops its sections");
+	const auto& original_imports = original_view.Directory(pe_directory_import);
+	const auto& restored_imports = restored_view.Directory(pe_directory_import);
+	check(restored_imports.VirtualAddress == original_imports.VirtualAddress
+	      && restored_imports.Size == original_imports.Size
+	      && !restored_view.Directory(pe_directory_delay_import).VirtualAddress,
+	      "import directories are restored");
+	check(memcmp(restored_view.Pointer(RVA{ rdata_rva + user32_iat }, 12),
+	             original_view.Pointer(RVA{ rdata_rva + user32_iat }, 12), 12) == 0,
+	      "IAT values are restored");
+	check(fixups(restored_view) == fixups(original_view), "IAT slots lose their relocations");
+
+	printf(failures ? "%d check(s) failed\n" : "All checks passed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,111 @@
+/*
+Minimal PE32 DLL images for the test programs in this directory. Sections are placed at
+consecutive RVAs from 0x1000, each aligned to 0x1000 in memory and 0x200 in the file.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "PEFormat.h"
+
+struct TestSection
+{
+	std::string name;
+	std::string data;
+	uint32_t characteristics;
+};
+
+const uint32_t test_section_alignment = 0x1000;
+const uint32_t test_file_alignment = 0x200;
+
+inline uint32_t test_align(uint32_t value, uint32_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+// RVA of the section with given index.
+inline uint32_t test_section_rva(const std::vector<TestSection>& sections, size_t index)
+{
+	uint32_t rva = test_section_alignment;
+	for (size_t i = 0; i < index; i++)
+		rva += test_align((uint32_t)sections[i].data.size(), test_section_alignment);
+	return rva;
+}
+
+// `directories` maps directory indices to (RVA, size).
+inline std::string build_test_dll(const std::vector<TestSection>& sections, uint32_t base,
+                                  uint32_t timestamp,
+                                  const std::map<uint32_t, std::pair<uint32_t, uint32_t>>& directories = {})
+{
+	using namespace PElib;
+	uint32_t nt_offset = sizeof(PeDosHeader);
+	uint32_t headers_size = test_align(nt_offset + sizeof(PeNtHeaders32)
+	                                   + (uint32_t)sections.size() * sizeof(PeSectionHeader),
+	                                   test_file_alignment);
+	std::string res(headers_size, '\0');
+
+	PeDosHeader dos = {};
+	dos.e_magic = pe_dos_signature;
+	dos.e_lfanew = nt_offset;
+	memcpy(&res[0], &dos, sizeof(dos));
+
+	PeNtHeaders32 nt = {};
+	nt.Signature = pe_nt_signature;
+	nt.FileHeader.Machine = 0x14C; // i386
+	nt.FileHeader.NumberOfSections = (uint16_t)sections.size();
+	nt.FileHeader.TimeDateStamp = timestamp;
+	nt.FileHeader.SizeOfOptionalHeader = sizeof(PeOptionalHeader32);
+	nt.FileHeader.Characteristics = pe_file_dll | 0x0102; // Executable, 32-bit machine
+	auto& optional = nt.OptionalHeader;
+	optional.Magic = pe_optional32_magic;
+	optional.ImageBase = base;
+	optional.SectionAlignment = test_section_alignment;
+	optional.FileAlignment = test_file_alignment;
+	optional.MajorSubsystemVersion = 5;
+	optional.SizeOfImage = test_section_rva(sections, sections.size());
+	optional.SizeOfHeaders = headers_size;
+	optional.Subsystem = 2; // Windows GUI
+	optional.NumberOfRvaAndSizes = pe_directory_entries;
+	for (const auto& directory : directories)
+	{
+		optional.DataDirectory[directory.first].VirtualAddress = directory.second.first;
+		optional.DataDirectory[directory.first].Size = directory.second.second;
+	}
+	memcpy(&res[nt_offset], &nt, sizeof(nt));
+
+	for (size_t i = 0; i < sections.size(); i++)
+	{
+		PeSectionHeader header = {};
+		memcpy(header.Name, sections[i].name.data(),
+		       std::min(sections[i].name.size(), sizeof(header.Name)));
+		header.VirtualSize = (uint32_t)sections[i].data.size();
+		header.VirtualAddress = test_section_rva(sections, i);
+		header.SizeOfRawData = test_align((uint32_t)sections[i].data.size(), test_file_alignment);
+		header.PointerToRawData = (uint32_t)res.size();
+		header.Characteristics = sections[i].characteristics;
+		memcpy(&res[nt_offset + sizeof(nt) + i * sizeof(header)], &header, sizeof(header));
+		res += sections[i].data;
+		res.resize(header.PointerToRawData + header.SizeOfRawData, '\0');
+	}
+	return res;
+}
+
+inline uint32_t test_read32(const std::string& data, size_t offset)
+{
+	uint32_t value;
+	memcpy(&value, data.data() + offset, sizeof(value));
+	return value;
+}
+
+inline void test_write32(std::string& data, size_t offset, uint32_t value)
+{
+	memcpy(&data[offset], &value, sizeof(value));
+}
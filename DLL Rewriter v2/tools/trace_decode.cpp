@@ -0,0 +1,92 @@
+/*
+Decodes argument traces (see TraceFormat.h) from a memory dump of a process using
+a DLL with tracing wrappers. Finds every "tracebuf" header in the dump and prints valid
+records ordered by timestamp. Portable, e.g.:
+	g++ -O2 -std=c++14 -I.. trace_decode.cpp -o trace_decode
+	./trace_decode <dump file>
+*/
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "TraceFormat.h"
+
+using PElib::TraceBufferHeader;
+using PElib::TraceHeader;
+using PElib::TraceRecord;
+using std::string;
+using std::vector;
+
+static bool is_power_of_2(uint32_t x)
+{
+	return x && !(x & (x - 1));
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s <dump file>\n", argv[0]);
+		return 1;
+	}
+	std::ifstream file(argv[1], std::ios::binary);
+	if (file.fail())
+	{
+		fprintf(stderr, "Cannot open file: %s\n", argv[1]);
+		return 1;
+	}
+	string dump((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	for (size_t pos = dump.find("DLLRTRCE"); pos != string::npos; pos = dump.find("DLLRTRCE", pos + 1))
+	{
+		TraceHeader header;
+		if (dump.size() - pos < sizeof(header))
+			break;
+		memcpy(&header, &dump[pos], sizeof(header));
+		if (header.version != 1 || header.record_size != sizeof(TraceRecord)
+			|| !is_power_of_2(header.buffer_count) || !is_power_of_2(header.records_per_buffer))
+			continue;
+		size_t buffer_size = sizeof(TraceBufferHeader)
+			+ (size_t)header.records_per_buffer * header.record_size;
+		if ((dump.size() - pos - sizeof(header)) / buffer_size < header.buffer_count)
+		{
+			fprintf(stderr, "Truncated trace buffers at offset %zx\n", pos);
+			continue;
+		}
+
+		vector<TraceRecord> records;
+		for (uint32_t b = 0; b < header.buffer_count; b++)
+		{
+			size_t buffer_pos = pos + sizeof(header) + b * buffer_size;
+			for (uint32_t r = 0; r < header.records_per_buffer; r++)
+			{
+				TraceRecord record;
+				memcpy(&record, &dump[buffer_pos + sizeof(TraceBufferHeader) + r * sizeof(record)],
+				       sizeof(record));
+				if (record.sequence) // 0: unused or torn
+					records.push_back(record);
+			}
+		}
+		std::sort(records.begin(), records.end(), [](const TraceRecord& a, const TraceRecord& b)
+		{
+			return a.timestamp < b.timestamp;
+		});
+
+		printf("Trace buffers at offset %zx: %zd records\n", pos, records.size());
+		for (const auto& record : records)
+		{
+			printf("%016" PRIx64 " tid=%u export=%u ret=%08x args:", record.timestamp,
+			       record.thread_id, record.export_index, record.return_address);
+			for (uint32_t i = 0; i < header.args_count && i < 8; i++)
+				printf(" %08x", record.args[i]);
+			printf("\n");
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,87 @@
+; Argument tracing wrappers. `trace_redirect` can be used instead of `redirect` from
+; short_jmp.asm for selected exports: every call stores the export index, thread id,
+; return address, timestamp and TRACE_ARGS stack arguments in a per-thread ring buffer
+; (layout is described in TraceFormat.h). Label values are RVAs (set with ORG) and the
+; code is position-independent.
+;
+; Generated code following this file invokes `trace_data` after `__data_begin:`, which
+; starts a separate, writable section. Only the header is stored in the file.
+
+%define TRACE_BUFFERS 64      ; Power of 2
+%define TRACE_RECORDS 256     ; Power of 2, per buffer
+%define TRACE_ARGS 8
+%define TRACE_RECORD_SIZE 64
+%define TRACE_BUFFER_SIZE (64 + TRACE_RECORDS * TRACE_RECORD_SIZE)
+
+; Called from a wrapper with export index as the only stack argument. Preserves all
+; registers, so arguments passed in them reach the original function.
+__trace_record:
+	push eax
+	push ecx
+	push edx
+	push ebx
+	push esi
+	push edi
+	; [esp + 24]: return to wrapper, [esp + 28]: export index,
+	; [esp + 32]: caller's return address, [esp + 36]: arguments
+	call .base
+.base:
+	pop ebx
+	sub ebx, .base                       ; ebx = image base
+	mov eax, [fs:0x24]                   ; Thread id (TEB.ClientId.UniqueThread)
+	mov esi, eax
+	shr esi, 2                           ; Thread ids are multiples of 4
+	and esi, TRACE_BUFFERS - 1
+	imul esi, esi, TRACE_BUFFER_SIZE
+	lea esi, [ebx + esi + __trace_buffers]
+	mov ecx, 1
+	lock xadd [esi], ecx                 ; Reserve a record, never blocks
+	lea edx, [ecx + 1]                   ; Its sequence
+	and ecx, TRACE_RECORDS - 1
+	shl ecx, 6
+	lea edi, [esi + ecx + 64]
+	mov dword [edi], 0                   ; Mark as being written
+	mov [edi + 8], eax
+	mov eax, [esp + 28]
+	mov [edi + 4], eax
+	mov eax, [esp + 32]
+	mov [edi + 12], eax
+	mov esi, edx
+	rdtsc
+	mov [edi + 16], eax
+	mov [edi + 20], edx
+%assign i 0
+%rep TRACE_ARGS
+	mov eax, [esp + 36 + i * 4]
+	mov [edi + 24 + i * 4], eax
+%assign i i + 1
+%endrep
+	mov [edi], esi                       ; Publish (x86 doesn't reorder stores)
+	pop edi
+	pop esi
+	pop ebx
+	pop edx
+	pop ecx
+	pop eax
+	ret 4
+
+%macro trace_redirect 2 ; Args: func address (RVA), func index
+	place_branch 5
+	longjmp_%2:
+		jmp %1
+	align 16, nop
+	entry_%2: ; Pointed by the export table, like in `redirect`
+		push %2
+		place_branch 5
+		call __trace_record
+		place_branch 2
+		jmp short longjmp_%2
+%endmacro
+
+%macro trace_data 0
+	__trace_header:
+		db 'DLLRTRCE'
+		dd 1, TRACE_BUFFERS, TRACE_RECORDS, TRACE_RECORD_SIZE, TRACE_ARGS
+		times 9 dd 0
+	__trace_buffers: ; Not stored in the file, zero-filled by the loader
+%endmacro